@@ -232,6 +232,7 @@ unix:!macx {
     #QMAKE_CXXFLAGS += -Wno-dangling-field
     QMAKE_CXXFLAGS += -Wno-unused-const-variable
     LIBS += -ldl
+    LIBS += -lpthread   # std::thread, used for parallel recalculation
 }
 
 # set up configuration flags used internally by the Stanford C++ libraries
@@ -490,4 +491,4 @@ exists($$PWD/lib/autograder/*.cpp) {
 # END SECTION FOR CS 106B/X AUTOGRADER PROGRAMS                               #
 ###############################################################################
 
-# END OF FILE (this should be line #493; if not, your .pro has been changed!)
+# END OF FILE (this should be line #494; if not, your .pro has been changed!)
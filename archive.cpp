@@ -0,0 +1,305 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the archive.h interface.
+ */
+
+#include "archive.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "checksum.h"
+#include "error.h"
+
+namespace {
+
+const size_t BLOCK_HEADER_SIZE = 13;
+
+// matches are at least this long, and found by hashing this many bytes
+const int MIN_MATCH = 4;
+const int HASH_BITS = 14;
+const int MAX_OFFSET = 65535;
+
+void putUint32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += (char) ((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint32_t getUint32(const char* p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) (unsigned char) p[i] << (8 * i);
+    }
+    return value;
+}
+
+uint32_t load32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// writes a length of 15 or more as the bytes that follow its token
+void putLength(std::string& out, int length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        out += (char) 255;
+    }
+    out += (char) length;
+}
+
+void putSequence(std::string& out, const unsigned char* literals, int literalCount,
+                 int offset, int matchLength) {
+    int matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    out += (char) ((literalCount < 15 ? literalCount : 15) << 4 | (matchCode < 15 ? matchCode : 15));
+    if (literalCount >= 15) {
+        putLength(out, literalCount);
+    }
+    out.append(reinterpret_cast<const char*>(literals), literalCount);
+    if (matchLength > 0) {
+        out += (char) (offset & 0xff);
+        out += (char) (offset >> 8);
+        if (matchCode >= 15) {
+            putLength(out, matchCode);
+        }
+    }
+}
+
+/*
+ * Compresses data into out, finding matches with a table of the last
+ * position of each hashed 4 bytes.  Greedy, like LZ4's fast mode: the
+ * first match found is taken and extended as far as it goes.
+ */
+void compressBlock(const std::string& data, std::string& out) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data.data());
+    int length = (int) data.length();
+    std::vector<int> table(1 << HASH_BITS, -1);
+    int anchor = 0;
+    int i = 0;
+    while (i + MIN_MATCH <= length) {
+        uint32_t sequence = load32(in + i);
+        uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+        int candidate = table[hash];
+        table[hash] = i;
+        if (candidate >= 0 && i - candidate <= MAX_OFFSET && load32(in + candidate) == sequence) {
+            int matchLength = MIN_MATCH;
+            while (i + matchLength < length && in[candidate + matchLength] == in[i + matchLength]) {
+                matchLength++;
+            }
+            putSequence(out, in + anchor, i - anchor, i - candidate, matchLength);
+            i += matchLength;
+            anchor = i;
+        } else {
+            i++;
+        }
+    }
+    putSequence(out, in + anchor, length - anchor, 0, 0);
+}
+
+// reads a length continued after its token
+bool getLength(const unsigned char*& p, const unsigned char* end, int& length) {
+    while (true) {
+        if (p == end) return false;
+        int byte = *p++;
+        length += byte;
+        if (length > ARCHIVE_BLOCK_SIZE) return false;
+        if (byte < 255) return true;
+    }
+}
+
+// decompresses a block into out, which must hold exactly rawLength bytes;
+// returns false if the block is damaged
+bool decompressBlock(const std::string& data, size_t rawLength, std::string& out) {
+    out.resize(rawLength);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.length();
+    size_t written = 0;
+    while (p < end) {
+        int token = *p++;
+        int literalCount = token >> 4;
+        if (literalCount == 15 && !getLength(p, end, literalCount)) return false;
+        if (literalCount > end - p || literalCount > (int) (rawLength - written)) return false;
+        memcpy(&out[written], p, literalCount);
+        p += literalCount;
+        written += literalCount;
+        if (p == end) break;
+
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        int matchLength = token & 15;
+        if (matchLength == 15 && !getLength(p, end, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > written || matchLength > (int) (rawLength - written)) {
+            return false;
+        }
+        // byte by byte, since a match may overlap the bytes it copies
+        for (int i = 0; i < matchLength; i++, written++) {
+            out[written] = out[written - offset];
+        }
+    }
+    return written == rawLength;
+}
+
+} // namespace
+
+ArchiveWriter::ArchiveWriter(std::ostream& out)
+        : out(out) {
+    std::string header(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    putUint32(header, ARCHIVE_VERSION);
+    out.write(header.data(), header.length());
+    block.reserve(ARCHIVE_BLOCK_SIZE);
+}
+
+void ArchiveWriter::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        putByte((char) ((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    putByte((char) value);
+}
+
+void ArchiveWriter::putDouble(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++) {
+        putByte((char) ((bits >> (8 * i)) & 0xff));
+    }
+}
+
+void ArchiveWriter::putString(const std::string& text) {
+    putVarint(text.length());
+    for (char ch : text) {
+        putByte(ch);
+    }
+}
+
+void ArchiveWriter::finish() {
+    // the empty block marks the end
+    if (!block.empty()) {
+        flushBlock();
+    }
+    flushBlock();
+    out.flush();
+}
+
+void ArchiveWriter::putByte(char byte) {
+    block += byte;
+    if (block.length() == (size_t) ARCHIVE_BLOCK_SIZE) {
+        flushBlock();
+    }
+}
+
+void ArchiveWriter::flushBlock() {
+    // store the block as it is if compressing it does not make it smaller
+    compressed.clear();
+    if (!block.empty()) {
+        compressBlock(block, compressed);
+    }
+    bool shrunk = compressed.length() < block.length();
+    const std::string& stored = shrunk ? compressed : block;
+    std::string header;
+    putUint32(header, (uint32_t) block.length());
+    putUint32(header, (uint32_t) stored.length());
+    putUint32(header, computeCrc32(block.data(), block.length()));
+    header += (char) (shrunk ? ARCHIVE_COMPRESSED : ARCHIVE_STORED);
+    out.write(header.data(), header.length());
+    out.write(stored.data(), stored.length());
+    block.clear();
+}
+
+ArchiveReader::ArchiveReader(std::istream& in)
+        : in(in),
+          position(0) {
+    char header[sizeof(ARCHIVE_MAGIC) + 4];
+    in.read(header, sizeof(header));
+    if (in.gcount() != (std::streamsize) sizeof(header)
+            || memcmp(header, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0) {
+        error("ArchiveReader: not an archive");
+    }
+    if (getUint32(header + sizeof(ARCHIVE_MAGIC)) != ARCHIVE_VERSION) {
+        error("ArchiveReader: unsupported archive version");
+    }
+}
+
+uint64_t ArchiveReader::getVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = (unsigned char) getByte();
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    error("ArchiveReader: bad number");
+    return 0;
+}
+
+double ArchiveReader::getDouble() {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        bits |= (uint64_t) (unsigned char) getByte() << (8 * i);
+    }
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string ArchiveReader::getString() {
+    uint64_t length = getVarint();
+    std::string text;
+    while (text.length() < length) {
+        if (position == block.length() && !readBlock()) {
+            error("ArchiveReader: archive ends early");
+        }
+        size_t count = std::min((size_t) (length - text.length()), block.length() - position);
+        text.append(block, position, count);
+        position += count;
+    }
+    return text;
+}
+
+void ArchiveReader::finish() {
+    if (position != block.length() || readBlock()) {
+        error("ArchiveReader: unexpected data at end of archive");
+    }
+}
+
+char ArchiveReader::getByte() {
+    if (position == block.length() && !readBlock()) {
+        error("ArchiveReader: archive ends early");
+    }
+    return block[position++];
+}
+
+bool ArchiveReader::readBlock() {
+    // read and check the next block; returns false at the end of the archive
+    char header[BLOCK_HEADER_SIZE];
+    in.read(header, sizeof(header));
+    if (in.gcount() != (std::streamsize) sizeof(header)) {
+        error("ArchiveReader: archive ends early");
+    }
+    uint32_t rawLength = getUint32(header);
+    uint32_t storedLength = getUint32(header + 4);
+    uint32_t checksum = getUint32(header + 8);
+    char method = header[12];
+    if (rawLength > (uint32_t) ARCHIVE_BLOCK_SIZE
+            || (method == ARCHIVE_STORED && storedLength != rawLength)
+            || (method == ARCHIVE_COMPRESSED && storedLength >= rawLength)
+            || (method != ARCHIVE_STORED && method != ARCHIVE_COMPRESSED)) {
+        error("ArchiveReader: bad block header");
+    }
+    std::string& target = method == ARCHIVE_STORED ? block : compressed;
+    target.resize(storedLength);
+    in.read(&target[0], storedLength);
+    if (in.gcount() != (std::streamsize) storedLength) {
+        error("ArchiveReader: archive ends early");
+    }
+    if (method == ARCHIVE_COMPRESSED && !decompressBlock(compressed, rawLength, block)) {
+        error("ArchiveReader: damaged block");
+    }
+    if (computeCrc32(block.data(), block.length()) != checksum) {
+        error("ArchiveReader: block checksum mismatch");
+    }
+    position = 0;
+    return rawLength > 0;
+}
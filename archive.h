@@ -0,0 +1,120 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the ArchiveWriter and ArchiveReader types, which
+ * carry the columnar archive format written by Spreadsheet::saveArchive
+ * through a stream as compressed, checksummed blocks.
+ */
+
+#ifndef _archive_h
+#define _archive_h
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+/**
+ * An archive is a header, ARCHIVE_MAGIC and a 4-byte version, followed by
+ * blocks holding one continuous stream of data.  Each block has a 13-byte
+ * header: the length of its data, the length it is stored in, the CRC-32
+ * of its data, all 4 bytes little-endian, and a byte saying how it is
+ * stored (ARCHIVE_STORED or ARCHIVE_COMPRESSED); a block whose data is
+ * empty ends the archive.  Blocks hold at most ARCHIVE_BLOCK_SIZE bytes of
+ * data, so a reader or writer only ever holds one block in memory.
+ *
+ * Compressed blocks use a byte-oriented LZ77 coding in the manner of LZ4:
+ * a run of sequences, each a token byte whose high and low 4 bits give the
+ * number of literal bytes and the length of the match less 4 (a value of
+ * 15 continuing in following bytes, each added on until one is below
+ * 255), the literal bytes, and a 2-byte offset back to the match.  The
+ * last sequence has only literals.
+ *
+ * Within the stream numbers are written as variable-length integers, 7
+ * bits a byte, lowest first, with the high bit set on every byte but the
+ * last, and doubles as their 8 bytes, little-endian.
+ */
+static const char ARCHIVE_MAGIC[8] = {'S', '1', '2', '3', 'A', 'R', 'C', 'H'};
+static const uint32_t ARCHIVE_VERSION = 1;
+static const int ARCHIVE_BLOCK_SIZE = 64 * 1024;
+
+enum ArchiveBlockMethod {
+    ARCHIVE_STORED = 0,
+    ARCHIVE_COMPRESSED = 1
+};
+
+/**
+ * Writes an archive to a stream, a block at a time.
+ */
+class ArchiveWriter {
+public:
+    /**
+     * Constructs a writer that writes the archive header to the given
+     * stream, which must outlive it.
+     */
+    ArchiveWriter(std::ostream& out);
+
+    /**
+     * Appends a value to the stream.
+     */
+    void putVarint(uint64_t value);
+    void putDouble(double value);
+    void putString(const std::string& text);
+
+    /**
+     * Writes the last block and the end of the archive.  Nothing may be
+     * written after this.
+     */
+    void finish();
+
+private:
+    void putByte(char byte);
+    void flushBlock();
+
+    std::ostream& out;
+    std::string block;
+    std::string compressed;
+
+    // writers are not copyable
+    ArchiveWriter(const ArchiveWriter&);
+    ArchiveWriter& operator =(const ArchiveWriter&);
+};
+
+/**
+ * Reads an archive from a stream, a block at a time.  Every method throws
+ * an ErrorException if the stream is not an archive, ends early or holds
+ * a block that does not match its checksum.
+ */
+class ArchiveReader {
+public:
+    /**
+     * Constructs a reader that reads and checks the archive header from
+     * the given stream, which must outlive it.
+     */
+    ArchiveReader(std::istream& in);
+
+    /**
+     * Reads the next value from the stream.
+     */
+    uint64_t getVarint();
+    double getDouble();
+    std::string getString();
+
+    /**
+     * Checks that the whole stream has been read and the archive ends.
+     */
+    void finish();
+
+private:
+    char getByte();
+    bool readBlock();
+
+    std::istream& in;
+    std::string block;
+    size_t position;
+    std::string compressed;
+
+    // readers are not copyable
+    ArchiveReader(const ArchiveReader&);
+    ArchiveReader& operator =(const ArchiveReader&);
+};
+
+#endif // _archive_h
@@ -0,0 +1,170 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the arena.h interface.
+ */
+
+#include "arena.h"
+#include <cstring>
+#include <new>
+
+const size_t Arena::ALIGNMENT;
+const size_t Arena::BLOCK_SIZE;
+const size_t Arena::MAX_SLOT_SIZE;
+const size_t ArenaObject::HEADER_SIZE;
+
+namespace {
+
+// memory from the arena, or from the heap when there is none
+void* allocateIn(Arena* arena, size_t size) {
+    return arena == nullptr ? ::operator new(size) : arena->allocate(size);
+}
+
+void releaseIn(Arena* arena, void* memory, size_t size) {
+    if (arena == nullptr) {
+        ::operator delete(memory);
+    } else {
+        arena->release(memory, size);
+    }
+}
+
+} // namespace
+
+Arena::Arena()
+        : reservedBytes(0),
+          next(nullptr),
+          end(nullptr) {
+    for (FreeSlot*& slot : freeSlots) {
+        slot = nullptr;
+    }
+}
+
+Arena::~Arena() {
+    reset();
+}
+
+void* Arena::allocate(size_t size) {
+    size = roundUp(size);
+    if (size <= MAX_SLOT_SIZE) {
+        FreeSlot*& slot = freeSlots[size / ALIGNMENT];
+        if (slot != nullptr) {
+            FreeSlot* reused = slot;
+            slot = reused->next;
+            return reused;
+        }
+    }
+    if ((size_t) (end - next) < size) {
+        // start a new block; an oversized piece gets a block of its own,
+        // leaving the current block to carry on
+        size_t blockSize = size > BLOCK_SIZE / 4 ? size : BLOCK_SIZE;
+        char* block = static_cast<char*>(::operator new(blockSize));
+        blocks.push_back(block);
+        reservedBytes += blockSize;
+        if (blockSize != BLOCK_SIZE) {
+            return block;
+        }
+        next = block;
+        end = block + blockSize;
+    }
+    void* memory = next;
+    next += size;
+    return memory;
+}
+
+void Arena::release(void* memory, size_t size) {
+    size = roundUp(size);
+    if (memory == nullptr || size > MAX_SLOT_SIZE) return;
+    FreeSlot* slot = static_cast<FreeSlot*>(memory);
+    slot->next = freeSlots[size / ALIGNMENT];
+    freeSlots[size / ALIGNMENT] = slot;
+}
+
+void Arena::reset() {
+    for (char* block : blocks) {
+        ::operator delete(block);
+    }
+    blocks.clear();
+    reservedBytes = 0;
+    next = nullptr;
+    end = nullptr;
+    for (FreeSlot*& slot : freeSlots) {
+        slot = nullptr;
+    }
+}
+
+size_t Arena::getReservedBytes() const {
+    return reservedBytes;
+}
+
+size_t Arena::roundUp(size_t size) {
+    // every piece must be able to hold a free-list link
+    if (size < sizeof(FreeSlot)) {
+        size = sizeof(FreeSlot);
+    }
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+void* ArenaObject::operator new(size_t size) {
+    return operator new(size, nullptr);
+}
+
+void* ArenaObject::operator new(size_t size, Arena* arena) {
+    char* memory = static_cast<char*>(allocateIn(arena, HEADER_SIZE + size));
+    *reinterpret_cast<Arena**>(memory) = arena;
+    return memory + HEADER_SIZE;
+}
+
+void ArenaObject::operator delete(void* memory, size_t size) {
+    if (memory == nullptr) return;
+    char* start = static_cast<char*>(memory) - HEADER_SIZE;
+    releaseIn(*reinterpret_cast<Arena**>(start), start, HEADER_SIZE + size);
+}
+
+void ArenaObject::operator delete(void* memory, Arena* arena) {
+    // only called when a constructor throws; the size is unknown, so memory
+    // from an arena stays used until the arena is reset
+    if (arena == nullptr) {
+        ::operator delete(static_cast<char*>(memory) - HEADER_SIZE);
+    }
+}
+
+Arena* ArenaObject::getArena() const {
+    const char* start = reinterpret_cast<const char*>(this) - HEADER_SIZE;
+    return *reinterpret_cast<Arena* const*>(start);
+}
+
+void* ArenaObject::allocateOwned(size_t size) const {
+    return allocateIn(getArena(), size);
+}
+
+void ArenaObject::releaseOwned(void* memory, size_t size) const {
+    if (memory != nullptr) {
+        releaseIn(getArena(), memory, size);
+    }
+}
+
+ArenaString::ArenaString()
+        : chars(nullptr),
+          length(0) {
+    /* Empty */
+}
+
+void ArenaString::assign(const std::string& str, Arena* arena) {
+    release(arena);
+    length = str.length();
+    if (length > 0) {
+        chars = static_cast<char*>(allocateIn(arena, length));
+        memcpy(chars, str.data(), length);
+    }
+}
+
+void ArenaString::release(Arena* arena) {
+    if (chars != nullptr) {
+        releaseIn(arena, chars, length);
+    }
+    chars = nullptr;
+    length = 0;
+}
+
+std::string ArenaString::toString() const {
+    return std::string(chars == nullptr ? "" : chars, length);
+}
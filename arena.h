@@ -0,0 +1,145 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the Arena type, a per-sheet memory pool for formula
+ * trees, along with ArenaObject and ArenaString, which let objects and the
+ * strings they hold live in one.
+ */
+
+#ifndef _arena_h
+#define _arena_h
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * A memory pool that hands out pieces of large blocks by bumping a pointer.
+ * A released piece goes onto a free list for its size and is handed out
+ * again before any new memory, so a sheet whose formulas keep being replaced
+ * reuses the same slots; pieces larger than MAX_SLOT_SIZE are not recycled
+ * and stay used until the next reset.  reset gives everything back at once,
+ * in time proportional to the number of blocks, without visiting the pieces.
+ *
+ * An arena is not thread-safe.
+ */
+class Arena {
+public:
+    /**
+     * Constructs an empty arena; no memory is reserved until it is needed.
+     */
+    Arena();
+
+    /**
+     * Frees every block of the arena.
+     */
+    ~Arena();
+
+    /**
+     * Returns size bytes of memory, aligned for any of the types stored here.
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Gives back memory returned by allocate(size).
+     */
+    void release(void* memory, size_t size);
+
+    /**
+     * Gives back every piece at once.  Destructors are not run, so this is
+     * only safe when nothing in the arena holds memory from outside it.
+     */
+    void reset();
+
+    /**
+     * Returns the number of bytes reserved from the system.
+     */
+    size_t getReservedBytes() const;
+
+private:
+    static const size_t ALIGNMENT = 8;
+    static const size_t BLOCK_SIZE = 64 * 1024;
+    static const size_t MAX_SLOT_SIZE = 1024;
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    std::vector<char*> blocks;
+    size_t reservedBytes;
+    char* next;                 // the unused part of the newest block
+    char* end;
+    FreeSlot* freeSlots[MAX_SLOT_SIZE / ALIGNMENT + 1];   // by size / ALIGNMENT
+
+    static size_t roundUp(size_t size);
+
+    // arenas are not copyable
+    Arena(const Arena&);
+    Arena& operator =(const Arena&);
+};
+
+/**
+ * A base class for objects that may be created in an arena:
+ *
+ *     Expression* exp = new (&arena) DoubleExp(42);
+ *
+ * A plain new, or a nullptr arena, puts the object on the heap as usual.
+ * Either way delete works, giving the memory back to wherever it came from,
+ * and the object can find its arena to allocate the memory it owns from
+ * the same place.  Such objects must always be created with new.
+ */
+class ArenaObject {
+public:
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, Arena* arena);
+    static void operator delete(void* memory, size_t size);
+    static void operator delete(void* memory, Arena* arena);
+
+protected:
+    /**
+     * Returns the arena this object lives in, or nullptr for the heap.
+     */
+    Arena* getArena() const;
+
+    /**
+     * Allocates and frees memory owned by this object, from its arena if it
+     * has one and from the heap otherwise.
+     */
+    void* allocateOwned(size_t size) const;
+    void releaseOwned(void* memory, size_t size) const;
+
+private:
+    // each object is preceded by the arena it came from
+    static const size_t HEADER_SIZE = 8;
+};
+
+/**
+ * A string whose characters are owned by an ArenaObject and allocated
+ * alongside it.  The owner passes its arena to assign and release; release
+ * must be called before the owner is destroyed unless the whole arena is
+ * being reset.
+ */
+class ArenaString {
+public:
+    ArenaString();
+
+    /**
+     * Replaces the contents by a copy of str.
+     */
+    void assign(const std::string& str, Arena* arena);
+
+    /**
+     * Frees the characters, leaving the string empty.
+     */
+    void release(Arena* arena);
+
+    /**
+     * Returns the contents as a std::string.
+     */
+    std::string toString() const;
+
+private:
+    char* chars;
+    int length;
+};
+
+#endif // _arena_h
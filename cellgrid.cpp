@@ -0,0 +1,256 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the cellgrid.h interface.
+ */
+
+#include "cellgrid.h"
+#include <algorithm>
+
+CellGrid::CellGrid()
+        : count(0) {
+    /* Empty */
+}
+
+CellGrid::~CellGrid() {
+    clear();
+}
+
+void CellGrid::clear() {
+    for (const std::pair<const uint64_t, Tile*>& entry : tiles) {
+        Tile* tile = entry.second;
+        for (int i = 0; i < TILE_SIZE * TILE_SIZE; i++) {
+            delete tile->nodes[i];
+        }
+        delete tile;
+    }
+    tiles.clear();
+    count = 0;
+}
+
+CellNode* CellGrid::find(const CellRef& cell) const {
+    if (!cell.isValid()) {
+        return nullptr;
+    }
+    int row = cell.getRow();
+    int column = cell.getColumn();
+    Tile* tile = findTile(row, column);
+    return tile == nullptr ? nullptr : tile->nodes[slot(row, column)];
+}
+
+CellNode* CellGrid::findOrCreate(const CellRef& cell, bool& created) {
+    int row = cell.getRow();
+    int column = cell.getColumn();
+    created = false;
+    Tile*& tile = tiles[tileKey(row >> TILE_BITS, column >> TILE_BITS)];
+    if (tile == nullptr) {
+        tile = new Tile();      // value-initialized: all 0.0 and nullptr
+    }
+    int index = slot(row, column);
+    if (tile->nodes[index] == nullptr) {
+        CellNode* node = new CellNode();
+        node->ref = cell;
+        node->value = &tile->values[index];
+        node->formula = nullptr;
+        node->bindings = nullptr;
+        node->order = 0;
+        node->dirty = false;
+        node->stored = false;
+        tile->nodes[index] = node;
+        tile->values[index] = 0.0;
+        count++;
+        created = true;
+    }
+    return tile->nodes[index];
+}
+
+void CellGrid::getNodes(Vector<CellNode*>& nodes) const {
+    for (const std::pair<const uint64_t, Tile*>& entry : tiles) {
+        Tile* tile = entry.second;
+        for (int i = 0; i < TILE_SIZE * TILE_SIZE; i++) {
+            if (tile->nodes[i] != nullptr) {
+                nodes.add(tile->nodes[i]);
+            }
+        }
+    }
+}
+
+void CellGrid::getNodesInRange(const Range& range, Vector<CellNode*>& nodes) const {
+    int startRow = range.getStartRow();
+    int startCol = range.getStartColumn();
+    int endRow = range.getEndRow();
+    int endCol = range.getEndColumn();
+    if (startRow > endRow || startCol > endCol || tiles.empty()) return;
+    int firstTileRow = startRow >> TILE_BITS;
+    int lastTileRow = endRow >> TILE_BITS;
+    int firstTileCol = startCol >> TILE_BITS;
+    int lastTileCol = endCol >> TILE_BITS;
+
+    // walk whichever is smaller: the tile positions the range spans or the
+    // tiles that exist
+    int64_t spanned = (int64_t) (lastTileRow - firstTileRow + 1)
+                      * (lastTileCol - firstTileCol + 1);
+    Vector<std::pair<uint64_t, Tile*> > overlapping;
+    if (spanned <= (int64_t) tiles.size()) {
+        for (int tileCol = firstTileCol; tileCol <= lastTileCol; tileCol++) {
+            for (int tileRow = firstTileRow; tileRow <= lastTileRow; tileRow++) {
+                std::unordered_map<uint64_t, Tile*>::const_iterator it =
+                        tiles.find(tileKey(tileRow, tileCol));
+                if (it != tiles.end()) {
+                    overlapping.add(*it);
+                }
+            }
+        }
+    } else {
+        for (const std::pair<const uint64_t, Tile*>& entry : tiles) {
+            int tileRow = (int) (entry.first >> 32);
+            int tileCol = (int) (entry.first & 0xffffffff);
+            if (firstTileRow <= tileRow && tileRow <= lastTileRow
+                    && firstTileCol <= tileCol && tileCol <= lastTileCol) {
+                overlapping.add(entry);
+            }
+        }
+    }
+
+    // visit only the part of each tile inside the range, down each column
+    // in turn, as the tile stores them
+    for (const std::pair<uint64_t, Tile*>& entry : overlapping) {
+        int tileTop = (int) (entry.first >> 32) << TILE_BITS;
+        int tileLeft = (int) (entry.first & 0xffffffff) << TILE_BITS;
+        int top = std::max(startRow, tileTop);
+        int bottom = std::min(endRow, tileTop + TILE_SIZE - 1);
+        int left = std::max(startCol, tileLeft);
+        int right = std::min(endCol, tileLeft + TILE_SIZE - 1);
+        for (int col = left; col <= right; col++) {
+            CellNode* const* column = &entry.second->nodes[slot(top, col)];
+            for (int i = 0; i <= bottom - top; i++) {
+                if (column[i] != nullptr) {
+                    nodes.add(column[i]);
+                }
+            }
+        }
+    }
+}
+
+ValueSpan CellGrid::getSpan(int row, int column, int endRow) const {
+    // a column's cells are contiguous within a tile, so the run stops at
+    // the tile's last row
+    int runEnd = ((row >> TILE_BITS) << TILE_BITS) + TILE_SIZE - 1;
+    if (runEnd > endRow) {
+        runEnd = endRow;
+    }
+    ValueSpan span;
+    Tile* tile = findTile(row, column);
+    span.values = tile == nullptr ? nullptr : &tile->values[slot(row, column)];
+    span.count = runEnd - row + 1;
+    return span;
+}
+
+double CellGrid::getValue(const CellRef& cell) const {
+    int row = cell.getRow();
+    int column = cell.getColumn();
+    Tile* tile = findTile(row, column);
+    return tile == nullptr ? 0.0 : tile->values[slot(row, column)];
+}
+
+void CellGrid::getValuesInRange(const Range& range, Vector<double>& values) const {
+    for (const ValueSpan& span : RangeView(*this, range)) {
+        for (int i = 0; i < span.count; i++) {
+            values.add(span.values == nullptr ? 0.0 : span.values[i]);
+        }
+    }
+}
+
+int CellGrid::size() const {
+    return count;
+}
+
+uint64_t CellGrid::tileKey(int tileRow, int tileCol) {
+    return ((uint64_t) tileRow << 32) | (uint32_t) tileCol;
+}
+
+int CellGrid::slot(int row, int column) {
+    // column-major inside the tile, so a column's cells are adjacent
+    return ((column & (TILE_SIZE - 1)) << TILE_BITS) | (row & (TILE_SIZE - 1));
+}
+
+CellGrid::Tile* CellGrid::findTile(int row, int column) const {
+    std::unordered_map<uint64_t, Tile*>::const_iterator it =
+            tiles.find(tileKey(row >> TILE_BITS, column >> TILE_BITS));
+    return it == tiles.end() ? nullptr : it->second;
+}
+
+RangeView::RangeView(const CellGrid& grid, const Range& range)
+        : grid(&grid),
+          startRow(range.getStartRow()),
+          startColumn(range.getStartColumn()),
+          endRow(range.getEndRow()),
+          endColumn(range.getEndColumn()) {
+    /* Empty */
+}
+
+RangeView::iterator RangeView::begin() const {
+    if (startRow > endRow || startColumn > endColumn) {
+        return end();
+    }
+    return iterator(grid, startRow, startColumn, startRow, endRow, endColumn);
+}
+
+RangeView::iterator RangeView::end() const {
+    // one past the last column, where incrementing the last span lands
+    return iterator(grid, startRow, endColumn + 1, startRow, endRow, endColumn);
+}
+
+int RangeView::size() const {
+    if (startRow > endRow || startColumn > endColumn) {
+        return 0;
+    }
+    return (endRow - startRow + 1) * (endColumn - startColumn + 1);
+}
+
+RangeView::iterator::iterator(const CellGrid* grid, int row, int column,
+                              int startRow, int endRow, int endColumn)
+        : grid(grid),
+          row(row),
+          column(column),
+          startRow(startRow),
+          endRow(endRow),
+          endColumn(endColumn) {
+    load();
+}
+
+const ValueSpan& RangeView::iterator::operator *() const {
+    return span;
+}
+
+const ValueSpan* RangeView::iterator::operator ->() const {
+    return &span;
+}
+
+RangeView::iterator& RangeView::iterator::operator ++() {
+    row += span.count;
+    if (row > endRow) {
+        row = startRow;
+        column++;
+    }
+    load();
+    return *this;
+}
+
+void RangeView::iterator::load() {
+    // look up the tile under the next run; past the last column there is
+    // nothing to read
+    if (column > endColumn) {
+        span.values = nullptr;
+        span.count = 0;
+    } else {
+        span = grid->getSpan(row, column, endRow);
+    }
+}
+
+bool RangeView::iterator::operator ==(const iterator& other) const {
+    return row == other.row && column == other.column;
+}
+
+bool RangeView::iterator::operator !=(const iterator& other) const {
+    return !(*this == other);
+}
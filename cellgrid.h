@@ -0,0 +1,195 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the CellGrid type, the sparse storage behind the
+ * spreadsheet's cells, and the CellNode record kept for each cell.
+ */
+
+#ifndef _cellgrid_h
+#define _cellgrid_h
+
+#include <stdint.h>
+#include <unordered_map>
+#include "cellref.h"
+#include "range.h"
+#include "set.h"
+#include "vector.h"
+
+class FormulaTemplate;
+
+/**
+ * The bookkeeping for one cell that has been set or is named by a formula.
+ * Its value lives in the grid's tile, reachable through the value pointer,
+ * so that range scans can read values without touching the nodes.
+ */
+struct CellNode {
+    CellRef ref;
+    double* value;                  // this cell's slot in its tile
+    FormulaTemplate* formula;       // nullptr for a cell with no formula
+    bool stored;                    // holds an imported value and no formula
+    CellNode** bindings;            // the cells formula names, shifted to this one
+    Vector<CellNode*> precedents;   // cells this one names, such as "=A1"
+    Set<CellNode*> dependents;      // cells that name this one
+    Vector<Range> ranges;           // ranges this one reads, such as "SUM(A1:A5)"
+    int order;                      // position in the topological order
+    bool dirty;                     // value out of date (lazy mode)
+};
+
+/**
+ * A run of adjacent cells down one column: count values starting at
+ * values, or count cells with no tile behind them when values is nullptr,
+ * which all read as 0.0.  The pointer is into the grid's own storage and
+ * is only good until the grid next changes.
+ */
+struct ValueSpan {
+    const double* values;
+    int count;
+};
+
+/**
+ * A sparse grid of cells keyed by their packed CellRef, stored as
+ * fixed-size square tiles.  Each tile keeps its values in one contiguous,
+ * column-major array, so a scan down a column streams through memory, and
+ * tiles are only allocated once a cell inside them exists, so empty areas
+ * of the sheet cost nothing.
+ */
+class CellGrid {
+public:
+    /* Tiles are TILE_SIZE x TILE_SIZE cells. */
+    static const int TILE_BITS = 6;
+    static const int TILE_SIZE = 1 << TILE_BITS;
+
+    /**
+     * Constructs an empty grid.
+     */
+    CellGrid();
+
+    /**
+     * Frees every tile and node.  Expressions are not owned by the grid.
+     */
+    ~CellGrid();
+
+    /**
+     * Removes every cell from the grid.
+     */
+    void clear();
+
+    /**
+     * Returns the node of the given cell, or nullptr if it does not exist.
+     */
+    CellNode* find(const CellRef& cell) const;
+
+    /**
+     * Returns the node of the given cell, creating it (with a value of 0.0)
+     * if needed.  Sets created to whether a new node was made.
+     */
+    CellNode* findOrCreate(const CellRef& cell, bool& created);
+
+    /**
+     * Appends every node in the grid to nodes, tile by tile.
+     */
+    void getNodes(Vector<CellNode*>& nodes) const;
+
+    /**
+     * Appends every existing node inside the given range to nodes.
+     * Only the part of each existing tile inside the range is visited.
+     */
+    void getNodesInRange(const Range& range, Vector<CellNode*>& nodes) const;
+
+    /**
+     * Returns the run of values from the given cell down to endRow or the
+     * bottom of the cell's tile, whichever comes first; endRow must not be
+     * above row.
+     */
+    ValueSpan getSpan(int row, int column, int endRow) const;
+
+    /**
+     * Returns the value of the given cell, or 0.0 if it does not exist.
+     */
+    double getValue(const CellRef& cell) const;
+
+    /**
+     * Appends the values of every cell inside the given range to values,
+     * column by column from top to bottom.  Missing cells read as 0.0.
+     */
+    void getValuesInRange(const Range& range, Vector<double>& values) const;
+
+    /**
+     * Returns the number of nodes in the grid.
+     */
+    int size() const;
+
+private:
+    struct Tile {
+        double values[TILE_SIZE * TILE_SIZE];      // column-major
+        CellNode* nodes[TILE_SIZE * TILE_SIZE];
+    };
+
+    std::unordered_map<uint64_t, Tile*> tiles;
+    int count;
+
+    static uint64_t tileKey(int tileRow, int tileCol);
+    static int slot(int row, int column);
+    Tile* findTile(int row, int column) const;
+
+    // grids are not copyable
+    CellGrid(const CellGrid&);
+    CellGrid& operator =(const CellGrid&);
+};
+
+/**
+ * A non-owning view of the values of a range of a grid, read as ValueSpans
+ * column by column from top to bottom, so that a function of the range can
+ * run over the grid's storage directly instead of over a copy:
+ *
+ *     for (const ValueSpan& span : RangeView(grid, range)) { ... }
+ *
+ * The view is only good until the grid next changes.
+ */
+class RangeView {
+public:
+    class iterator {
+    public:
+        const ValueSpan& operator *() const;
+        const ValueSpan* operator ->() const;
+        iterator& operator ++();
+        bool operator ==(const iterator& other) const;
+        bool operator !=(const iterator& other) const;
+
+    private:
+        friend class RangeView;
+
+        const CellGrid* grid;
+        int row;
+        int column;
+        int startRow;
+        int endRow;
+        int endColumn;
+        ValueSpan span;     // the run starting at (row, column)
+
+        iterator(const CellGrid* grid, int row, int column,
+                 int startRow, int endRow, int endColumn);
+        void load();
+    };
+
+    /**
+     * Constructs a view of the given range of the grid.
+     */
+    RangeView(const CellGrid& grid, const Range& range);
+
+    iterator begin() const;
+    iterator end() const;
+
+    /**
+     * Returns the number of cells in the range, 0 if it is empty.
+     */
+    int size() const;
+
+private:
+    const CellGrid* grid;
+    int startRow;
+    int startColumn;
+    int endRow;
+    int endColumn;
+};
+
+#endif // _cellgrid_h
@@ -0,0 +1,152 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the cellref.h interface.
+ */
+
+#include "cellref.h"
+#include <climits>
+
+const int CellRef::MAX_NAME_LENGTH;
+const uint64_t CellRef::INVALID_KEY;
+
+namespace {
+
+/*
+ * Character classes for the decoder: letter[c] is the 1-based value of a
+ * column letter in either case and digit[c] is one more than the value of
+ * a decimal digit, both 0 for any other character; space[c] marks the
+ * whitespace that may surround a name.
+ */
+struct CharTable {
+    unsigned char letter[256];
+    unsigned char digit[256];
+    bool space[256];
+
+    CharTable() {
+        for (int c = 0; c < 256; c++) {
+            letter[c] = 0;
+            digit[c] = 0;
+            space[c] = false;
+        }
+        for (int i = 0; i < 26; i++) {
+            letter['A' + i] = (unsigned char) (i + 1);
+            letter['a' + i] = (unsigned char) (i + 1);
+        }
+        for (int i = 0; i < 10; i++) {
+            digit['0' + i] = (unsigned char) (i + 1);
+        }
+        space[(unsigned char) ' '] = true;
+        space[(unsigned char) '\t'] = true;
+        space[(unsigned char) '\n'] = true;
+        space[(unsigned char) '\r'] = true;
+        space[(unsigned char) '\f'] = true;
+        space[(unsigned char) '\v'] = true;
+    }
+};
+
+const CharTable TABLE;
+
+// "00" "01" ... "99", so the encoder can write two row digits at a time
+const char DIGIT_PAIRS[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+} // namespace
+
+int CellRef::format(char* buffer) const {
+    if (!isValid()) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    // column letters come out least significant first, as do row digits,
+    // so both are written backwards into a scratch buffer
+    char scratch[MAX_NAME_LENGTH];
+    char* end = scratch + MAX_NAME_LENGTH;
+    char* p = end;
+    unsigned int row = (unsigned int) getRow() + 1;     // 1-based
+    while (row >= 100) {
+        unsigned int pair = (row % 100) * 2;
+        row /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (row >= 10) {
+        *--p = DIGIT_PAIRS[row * 2 + 1];
+        *--p = DIGIT_PAIRS[row * 2];
+    } else {
+        *--p = (char) ('0' + row);
+    }
+
+    // a roughly base-26 Excel column name, e.g. 0 -> "A", 26 -> "AA"
+    unsigned int col = (unsigned int) getColumn() + 1;  // 1-based
+    while (col-- > 0) {
+        *--p = (char) ('A' + col % 26);
+        col /= 26;
+    }
+
+    int length = (int) (end - p);
+    for (int i = 0; i < length; i++) {
+        buffer[i] = p[i];
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+bool CellRef::parse(const char* begin, const char* end, CellRef& result) {
+    while (begin < end && TABLE.space[(unsigned char) *begin]) {
+        begin++;
+    }
+    while (end > begin && TABLE.space[(unsigned char) end[-1]]) {
+        end--;
+    }
+
+    // one or more column letters ...
+    int64_t col = 0;
+    const char* p = begin;
+    while (p < end && TABLE.letter[(unsigned char) *p] != 0) {
+        col = col * 26 + TABLE.letter[(unsigned char) *p];
+        if (col - 1 > INT_MAX) {
+            return false;
+        }
+        p++;
+    }
+    if (p == begin) {
+        return false;
+    }
+
+    // ... followed by a 1-based row number and nothing else
+    int64_t row = 0;
+    const char* digits = p;
+    while (p < end && TABLE.digit[(unsigned char) *p] != 0) {
+        row = row * 10 + (TABLE.digit[(unsigned char) *p] - 1);
+        if (row - 1 > INT_MAX) {
+            return false;
+        }
+        p++;
+    }
+    if (p == digits || p != end || row < 1) {
+        return false;
+    }
+
+    result = CellRef((int) (row - 1), (int) (col - 1));
+    return true;
+}
+
+bool CellRef::parse(const std::string& cellname, CellRef& result) {
+    const char* text = cellname.data();
+    return parse(text, text + cellname.length(), result);
+}
+
+std::string CellRef::toString() const {
+    char buffer[MAX_NAME_LENGTH + 1];
+    int length = format(buffer);
+    return std::string(buffer, length);
+}
+
+std::ostream& operator <<(std::ostream& out, const CellRef& cell) {
+    char buffer[CellRef::MAX_NAME_LENGTH + 1];
+    int length = cell.format(buffer);
+    return out.write(buffer, length);
+}
@@ -0,0 +1,142 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the CellRef type, a cell location packed into a single
+ * integer, along with the conversions between it and Excel-style names.
+ */
+
+#ifndef _cellref_h
+#define _cellref_h
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+/**
+ * A 0-based (row, column) cell location packed into one 64-bit key, with the
+ * row in the high half, so that comparing keys orders cells row by row.
+ * CellRefs are cheap to copy, compare and hash, and are what the engine
+ * passes around internally; names such as "C7" are only produced or parsed
+ * at the edges, when reading files or talking to the GUI.
+ */
+class CellRef {
+public:
+    /**
+     * The longest name toString() can produce, not counting the terminating
+     * null character: 7 column letters and 10 row digits.
+     */
+    static const int MAX_NAME_LENGTH = 17;
+
+    /**
+     * Constructs an invalid reference, which refers to no cell.
+     */
+    CellRef();
+
+    /**
+     * Constructs a reference to the given 0-based row and column.
+     * The reference is invalid if either one is negative.
+     */
+    CellRef(int row, int column);
+
+    /**
+     * Returns the 0-based column of this cell.
+     */
+    int getColumn() const;
+
+    /**
+     * Returns the packed key of this cell.
+     */
+    uint64_t getKey() const;
+
+    /**
+     * Returns the 0-based row of this cell.
+     */
+    int getRow() const;
+
+    /**
+     * Returns true if this reference refers to a cell.
+     */
+    bool isValid() const;
+
+    /**
+     * Writes the Excel-style name of this cell, such as "C7", into the given
+     * buffer of at least MAX_NAME_LENGTH + 1 characters, null-terminated,
+     * and returns its length.  Writes an empty name for an invalid reference.
+     * Does not allocate memory.
+     */
+    int format(char* buffer) const;
+
+    /**
+     * Parses the Excel-style cell name in [begin, end), such as "C7" or
+     * " c7 ", into result.  Letters may be in either case, and whitespace
+     * around the name is ignored.  Returns true if successful and false if
+     * the text is not a cell name, leaving result unchanged.
+     * Does not allocate memory.
+     */
+    static bool parse(const char* begin, const char* end, CellRef& result);
+
+    /**
+     * Parses the given Excel-style cell name into result, as above.
+     */
+    static bool parse(const std::string& cellname, CellRef& result);
+
+    /**
+     * Returns the Excel-style name of this cell, such as "C7".
+     */
+    std::string toString() const;
+
+    bool operator ==(const CellRef& other) const;
+    bool operator !=(const CellRef& other) const;
+    bool operator <(const CellRef& other) const;
+
+private:
+    static const uint64_t INVALID_KEY = ~UINT64_C(0);
+
+    uint64_t key;
+};
+
+std::ostream& operator <<(std::ostream& out, const CellRef& cell);
+
+/*
+ * The accessors are defined here so that they can be inlined into the
+ * engine's inner loops.
+ */
+inline CellRef::CellRef()
+        : key(INVALID_KEY) {
+    /* Empty */
+}
+
+inline CellRef::CellRef(int row, int column)
+        : key(row < 0 || column < 0 ? INVALID_KEY
+              : ((uint64_t) row << 32) | (uint32_t) column) {
+    /* Empty */
+}
+
+inline int CellRef::getColumn() const {
+    return (int) (key & UINT64_C(0xffffffff));
+}
+
+inline uint64_t CellRef::getKey() const {
+    return key;
+}
+
+inline int CellRef::getRow() const {
+    return (int) (key >> 32);
+}
+
+inline bool CellRef::isValid() const {
+    return key != INVALID_KEY;
+}
+
+inline bool CellRef::operator ==(const CellRef& other) const {
+    return key == other.key;
+}
+
+inline bool CellRef::operator !=(const CellRef& other) const {
+    return key != other.key;
+}
+
+inline bool CellRef::operator <(const CellRef& other) const {
+    return key < other.key;
+}
+
+#endif // _cellref_h
@@ -0,0 +1,27 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the checksum.h interface.
+ */
+
+#include "checksum.h"
+#include <mutex>
+
+uint32_t computeCrc32(const char* data, size_t length, uint32_t crc) {
+    // the table-driven form of the reflected polynomial 0xedb88320
+    static uint32_t table[256];
+    static std::once_flag once;
+    std::call_once(once, [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xedb88320 ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+    });
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ (unsigned char) data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
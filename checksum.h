@@ -0,0 +1,19 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the checksum used to detect damaged records in the
+ * journal and damaged blocks in archives.
+ */
+
+#ifndef _checksum_h
+#define _checksum_h
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * Returns the CRC-32 (the checksum used by zip and PNG) of the given bytes,
+ * continuing from the checksum of the bytes before them, if any.
+ */
+uint32_t computeCrc32(const char* data, size_t length, uint32_t crc = 0);
+
+#endif // _checksum_h
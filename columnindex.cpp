@@ -0,0 +1,78 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the columnindex.h interface.
+ */
+
+#include "columnindex.h"
+
+ColumnIndex::ColumnIndex(IndexedFunction function, const Vector<double>& values)
+        : function(function) {
+    capacity = 1;
+    while (capacity < values.size()) {
+        capacity *= 2;
+    }
+    nodes.assign(2 * capacity, 0.0);
+    for (int row = 0; row < values.size(); row++) {
+        nodes[capacity + row] = values[row];
+    }
+    for (int i = capacity - 1; i >= 1; i--) {
+        nodes[i] = combine(function, nodes[2 * i], nodes[2 * i + 1]);
+    }
+}
+
+double ColumnIndex::combine(IndexedFunction function, double a, double b) {
+    // MIN and MAX keep the left value on ties and NaNs, as a scan does
+    switch (function) {
+    case INDEX_SUM:
+        return a + b;
+    case INDEX_MIN:
+        return b < a ? b : a;
+    case INDEX_MAX:
+        return b > a ? b : a;
+    case INDEX_PRODUCT:
+        return a * b;
+    }
+    return a;
+}
+
+int ColumnIndex::getCapacity() const {
+    return capacity;
+}
+
+IndexedFunction ColumnIndex::getFunction() const {
+    return function;
+}
+
+double ColumnIndex::query(int startRow, int endRow) const {
+    // standard bottom-up walk: combine the nodes hanging off the two
+    // boundaries, keeping the left-to-right order of the rows
+    int lo = capacity + startRow;
+    int hi = capacity + endRow + 1;
+    bool haveLeft = false, haveRight = false;
+    double left = 0.0, right = 0.0;
+    while (lo < hi) {
+        if (lo & 1) {
+            left = haveLeft ? combine(function, left, nodes[lo]) : nodes[lo];
+            haveLeft = true;
+            lo++;
+        }
+        if (hi & 1) {
+            hi--;
+            right = haveRight ? combine(function, nodes[hi], right) : nodes[hi];
+            haveRight = true;
+        }
+        lo /= 2;
+        hi /= 2;
+    }
+    if (!haveRight) return left;
+    if (!haveLeft) return right;
+    return combine(function, left, right);
+}
+
+void ColumnIndex::set(int row, double value) {
+    int i = capacity + row;
+    nodes[i] = value;
+    for (i /= 2; i >= 1; i /= 2) {
+        nodes[i] = combine(function, nodes[2 * i], nodes[2 * i + 1]);
+    }
+}
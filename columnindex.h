@@ -0,0 +1,75 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the ColumnIndex type, which answers aggregate queries
+ * over a run of rows in one column without rescanning the cells.
+ */
+
+#ifndef _columnindex_h
+#define _columnindex_h
+
+#include <vector>
+#include "vector.h"
+
+/**
+ * The range functions a ColumnIndex can answer.
+ */
+enum IndexedFunction {INDEX_SUM, INDEX_MIN, INDEX_MAX, INDEX_PRODUCT};
+
+/* The number of IndexedFunction values. */
+const int INDEXED_FUNCTION_COUNT = 4;
+
+/**
+ * A segment tree over the values of rows [0, capacity) of one column for one
+ * function.  The values sit at the leaves of a complete binary tree whose
+ * inner nodes hold the function applied to their subtree, so the function
+ * of any run of rows takes O(log n) and changing one value takes O(log n).
+ * Each ancestor of a changed value is recomputed from its two children
+ * rather than adjusted by the difference, as a Fenwick tree would be, so no
+ * rounding error builds up over many updates and the tree always holds
+ * exactly the results for its current values.
+ */
+class ColumnIndex {
+public:
+    /**
+     * Constructs an index computing the given function over the given values,
+     * which are rows [0, values.size()) of the column.  The capacity is
+     * values.size() rounded up to a power of two; the rows past the end
+     * start as 0.0.
+     */
+    ColumnIndex(IndexedFunction function, const Vector<double>& values);
+
+    /**
+     * Returns the function applied to two partial results, such as the
+     * results for two columns of a range.
+     */
+    static double combine(IndexedFunction function, double a, double b);
+
+    /**
+     * Returns the number of rows the index covers.
+     */
+    int getCapacity() const;
+
+    /**
+     * Returns the function this index computes.
+     */
+    IndexedFunction getFunction() const;
+
+    /**
+     * Returns the function applied to the values of rows [startRow, endRow],
+     * which must lie below the capacity, with startRow <= endRow.
+     */
+    double query(int startRow, int endRow) const;
+
+    /**
+     * Sets the value of the given row, which must be below the capacity.
+     */
+    void set(int row, double value);
+
+private:
+    IndexedFunction function;
+    int capacity;
+    std::vector<double> nodes;  // nodes[capacity + row] is the value of row;
+                                // nodes[i] combines nodes[2i] and nodes[2i + 1]
+};
+
+#endif // _columnindex_h
@@ -0,0 +1,261 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the csv.h interface.
+ */
+
+#include "csv.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include "error.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// the powers of ten that a double holds exactly
+const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+const int MAX_EXACT_POWER = 22;
+
+// the largest integer below which every integer is a double
+const uint64_t MAX_EXACT_MANTISSA = (uint64_t) 1 << 53;
+
+// more significant digits than this may not fit in 64 bits
+const int MAX_MANTISSA_DIGITS = 19;
+
+inline bool isDigit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+inline bool isBlank(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+inline bool isSeparator(char ch) {
+    return ch == ',' || ch == '\n' || ch == '\r' || ch == '"';
+}
+
+/*
+ * Returns the first comma, line break or quote in [p, end), or end if
+ * there is none.  With SSE2 each 16 characters are compared against all
+ * four at once, and the first match is found from the mask of the results.
+ */
+const char* findSeparator(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i ret = _mm_set1_epi8('\r');
+    const __m128i quote = _mm_set1_epi8('"');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i matches = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, newline)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, ret), _mm_cmpeq_epi8(chunk, quote)));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif // __SSE2__
+    while (p < end && !isSeparator(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// converts [begin, end) with strtod on a null-terminated copy
+double convert(const char* begin, const char* end) {
+    char buffer[64];
+    if (end - begin >= (int) sizeof(buffer)) {
+        return strtod(std::string(begin, end).c_str(), nullptr);
+    }
+    memcpy(buffer, begin, end - begin);
+    buffer[end - begin] = '\0';
+    return strtod(buffer, nullptr);
+}
+
+} // namespace
+
+std::string CsvField::toString() const {
+    if (!escaped) {
+        return std::string(text, length);
+    }
+    std::string result;
+    result.reserve(length);
+    for (int i = 0; i < length; i++) {
+        result += text[i];
+        if (text[i] == '"') {
+            i++;
+        }
+    }
+    return result;
+}
+
+CsvScanner::CsvScanner(const char* data, size_t size)
+        : position(data),
+          end(data + size),
+          record(0) {
+    // empty
+}
+
+int CsvScanner::getRecord() const {
+    return record;
+}
+
+bool CsvScanner::nextField(CsvField& field) {
+    if (position == end) {
+        return false;
+    }
+    field.escaped = false;
+    if (*position == '"') {
+        // a quoted field ends at a quote that is not doubled
+        field.text = ++position;
+        while (true) {
+            const char* quote = static_cast<const char*>(memchr(position, '"', end - position));
+            if (quote == nullptr) {
+                error("CSV: unterminated quoted field in record "
+                      + std::to_string(record + 1));
+            }
+            position = quote + 1;
+            if (position < end && *position == '"') {
+                field.escaped = true;
+                position++;
+            } else {
+                field.length = (int) (quote - field.text);
+                break;
+            }
+        }
+        if (position < end && *position != ',' && *position != '\n' && *position != '\r') {
+            error("CSV: unexpected text after quoted field in record "
+                  + std::to_string(record + 1));
+        }
+    } else {
+        // an unquoted field ends at a separator; quotes inside it are kept
+        field.text = position;
+        position = findSeparator(position, end);
+        while (position < end && *position == '"') {
+            position = findSeparator(position + 1, end);
+        }
+        field.length = (int) (position - field.text);
+    }
+
+    field.endsRecord = position == end || *position != ',';
+    if (position < end) {
+        if (*position == '\r' && position + 1 < end && position[1] == '\n') {
+            position++;
+        }
+        position++;
+    }
+    if (field.endsRecord) {
+        record++;
+    }
+    return true;
+}
+
+bool parseCsvNumber(const char* text, int length, double& value) {
+    const char* p = text;
+    const char* end = text + length;
+    while (p < end && isBlank(*p)) p++;
+    while (end > p && isBlank(end[-1])) end--;
+    const char* begin = p;
+
+    // read the digits into an integer mantissa and a decimal exponent
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    for (; p < end && isDigit(*p); p++) {
+        hasDigits = true;
+        if (digits < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            digits++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++) {
+            hasDigits = true;
+            if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            } else {
+                digits++;
+            }
+        }
+    }
+    if (!hasDigits) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p == end || !isDigit(*p)) {
+            return false;
+        }
+        int written = 0;
+        for (; p < end && isDigit(*p); p++) {
+            if (written < 100000) {
+                written = written * 10 + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+    if (p != end) {
+        return false;
+    }
+
+    // a mantissa and a power of ten that are both exact give a correctly
+    // rounded result with a single operation; anything else needs strtod
+    double result;
+    if (digits <= MAX_MANTISSA_DIGITS && mantissa <= MAX_EXACT_MANTISSA
+            && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+        result = (double) mantissa;
+        if (exponent < 0) {
+            result /= EXACT_POWERS_OF_TEN[-exponent];
+        } else {
+            result *= EXACT_POWERS_OF_TEN[exponent];
+        }
+        if (negative) {
+            result = -result;
+        }
+    } else {
+        result = convert(begin, end);
+        if (std::isinf(result)) {
+            return false;
+        }
+    }
+    value = result;
+    return true;
+}
+
+int formatCsvNumber(double value, char* buffer) {
+    // try more digits until the text reads back as the same bits
+    int length = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(buffer, MAX_CSV_NUMBER_LENGTH + 1, "%.*g", precision, value);
+        double parsed = strtod(buffer, nullptr);
+        if (memcmp(&parsed, &value, sizeof(double)) == 0) {
+            break;
+        }
+    }
+    return length;
+}
@@ -0,0 +1,88 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the CsvScanner type, which splits the text of a CSV
+ * file into fields, and the conversions between numbers and CSV text.
+ */
+
+#ifndef _csv_h
+#define _csv_h
+
+#include <cstddef>
+#include <string>
+
+/**
+ * One field of a CSV record, viewed in place in the scanned text.
+ * A quoted field is viewed without its quotes, so any doubled quotes in it
+ * still stand for one; toString() gives the field's actual text.
+ */
+struct CsvField {
+    const char* text;
+    int length;
+    bool escaped;       // whether text holds doubled quotes
+    bool endsRecord;    // whether this is the last field of its record
+
+    /**
+     * Returns a copy of this field's text with doubled quotes undone.
+     */
+    std::string toString() const;
+};
+
+/**
+ * A scanner over the text of a CSV file as described by RFC 4180: fields
+ * are separated by commas and records by line breaks (\n, \r\n or \r).
+ * A field in double quotes may hold commas, line breaks and doubled quotes;
+ * a quote inside a field that does not start with one is just a character.
+ * Unquoted fields are searched for their end 16 characters at a time with
+ * SSE2 where the processor has it, and one at a time elsewhere.
+ */
+class CsvScanner {
+public:
+    /**
+     * Constructs a scanner over the given text, which must outlive it.
+     */
+    CsvScanner(const char* data, size_t size);
+
+    /**
+     * Reads the next field into field and returns true, or returns false
+     * if the text has run out.  A line break at the very end of the text
+     * does not start another record.  Throws an ErrorException if a quoted
+     * field is not closed, or is followed by anything but a separator.
+     */
+    bool nextField(CsvField& field);
+
+    /**
+     * Returns the 0-based number of the record the next field belongs to.
+     */
+    int getRecord() const;
+
+private:
+    const char* position;
+    const char* end;
+    int record;
+};
+
+/**
+ * Parses the text [text, text + length) as a decimal number, such as "12",
+ * "-0.5" or "6.02e23", ignoring spaces and tabs around it, into value.
+ * Returns false, leaving value unchanged, if the text is anything else or
+ * too large for a double.  Numbers whose digits fit in 53 bits, with at most
+ * 22 digits between them and the decimal point, are converted exactly with
+ * one multiplication or division; the rest go through strtod.
+ */
+bool parseCsvNumber(const char* text, int length, double& value);
+
+/**
+ * The longest text formatCsvNumber can produce, not counting the
+ * terminating null character.
+ */
+static const int MAX_CSV_NUMBER_LENGTH = 31;
+
+/**
+ * Writes the shortest text that parses back to exactly the given value,
+ * such as "0.1" or "1e+300", into the given buffer of at least
+ * MAX_CSV_NUMBER_LENGTH + 1 characters, null-terminated, and returns its
+ * length.
+ */
+int formatCsvNumber(double value, char* buffer);
+
+#endif // _csv_h
@@ -13,6 +13,7 @@
  */
 
 #include "expression.h"
+#include <algorithm>
 #include "error.h"
 #include "strlib.h"
 #include "spreadsheet.h"
@@ -24,17 +25,16 @@
  * are not designated as pure virtual.
  */
 Expression::Expression()
-        : rawText(""),
-          value(0.0) {
+        : value(0.0) {
     /* Empty */
 }
 
 Expression::~Expression() {
-    /* Empty */
+    rawText.release(getArena());
 }
 
 std::string Expression::getRawText() const {
-    return rawText;
+    return rawText.toString();
 }
 
 double Expression::getValue() const {
@@ -47,7 +47,7 @@ bool Expression::isFormula() const {
 }
 
 void Expression::setRawText(const std::string& rawText) {
-    this->rawText = rawText;
+    this->rawText.assign(rawText, getArena());
 }
 
 void Expression::setValue(double value) {
@@ -69,6 +69,11 @@ std::string Expression::getOperator() const {
     return "";
 }
 
+CellRef Expression::getCellRef() const {
+    error("Expression::getCellRef: called on a non-Identifier expression object");
+    return CellRef();
+}
+
 Range Expression::getRange() const {
     error("Expression::getRange: called on a non-Range expression object");
     return Range();
@@ -90,13 +95,13 @@ const Expression* Expression::getRight() const {
 Set<std::string> CompoundExp::KNOWN_OPERATORS {"+", "-", "*", "/"};
 
 CompoundExp::CompoundExp(const std::string& op, Expression* lhs, Expression* rhs) {
-    this->op = op;
     if (!lhs) {
         error("CompoundExp::constructor: null left sub-expression");
     }
     if (!rhs) {
         error("CompoundExp::constructor: null right sub-expression");
     }
+    this->op.assign(op, getArena());
     this->lhs = lhs;
     this->rhs = rhs;
 }
@@ -104,9 +109,11 @@ CompoundExp::CompoundExp(const std::string& op, Expression* lhs, Expression* rhs
 CompoundExp::~CompoundExp() {
     delete lhs;
     delete rhs;
+    op.release(getArena());
 }
 
 double CompoundExp::eval(Spreadsheet& model) {
+    std::string op = this->op.toString();
     if (!KNOWN_OPERATORS.contains(op)) {
         error("Illegal operator in expression: " + op);
     }
@@ -131,7 +138,7 @@ const Expression* CompoundExp::getLeft() const {
 }
 
 std::string CompoundExp::getOperator() const {
-    return op;
+    return op.toString();
 }
 
 const Expression* CompoundExp::getRight() const {
@@ -143,7 +150,7 @@ ExpressionType CompoundExp::getType() const {
 }
 
 std::string CompoundExp::toString() const {
-    return '(' + lhs->toString() + ' ' + op + ' ' + rhs->toString() + ')';
+    return '(' + lhs->toString() + ' ' + op.toString() + ' ' + rhs->toString() + ')';
 }
 
 /**
@@ -176,14 +183,19 @@ std::string DoubleExp::toString() const {
  * using your spreadsheet to get its value.
  */
 IdentifierExp::IdentifierExp(const std::string& name) {
-    this->name = name;
+    this->name.assign(name, getArena());
+    CellRef::parse(name, cell);
+}
+
+IdentifierExp::~IdentifierExp() {
+    name.release(getArena());
 }
 
 double IdentifierExp::eval(Spreadsheet& model) {
-    if (!Range::isValidName(name)) {
-        error(name + " is not valid cell name.");
+    if (!cell.isValid()) {
+        error(name.toString() + " is not valid cell name.");
     }
-    double result = model.getCellCalculatedValue(name);
+    double result = model.getCellCalculatedValue(cell);
     setValue(result);
     return result;
 }
@@ -193,7 +205,11 @@ ExpressionType IdentifierExp::getType() const {
 }
 
 std::string IdentifierExp::toString() const {
-    return name;
+    return name.toString();
+}
+
+CellRef IdentifierExp::getCellRef() const {
+    return cell;
 }
 
 /**
@@ -202,31 +218,48 @@ std::string IdentifierExp::toString() const {
  * None.
  */
 RangeExp::RangeExp(const std::string& function, Range cells) {
-    this->function = toUpperCase(trim(function));
+    this->function.assign(toUpperCase(trim(function)), getArena());
     this->cells = cells;
+    this->argument = 0.0;
+}
+
+RangeExp::RangeExp(const std::string& function, Range cells, double argument) {
+    this->function.assign(toUpperCase(trim(function)), getArena());
+    this->cells = cells;
+    this->argument = argument;
+}
+
+RangeExp::~RangeExp() {
+    function.release(getArena());
 }
 
 double RangeExp::eval(Spreadsheet& model) {
-    if (!Range::isKnownFunctionName(this->function)) {
+    std::string function = this->function.toString();
+    if (!Range::isKnownFunctionName(function)) {
         error("Unknown function name: " + function);
     }
-    Vector<double> valuesInRange;
-    model.fillFromRange(cells, valuesInRange);
     double result = 0.0;
     if (function == "AVERAGE" || function == "MEAN") {
-        result = average(valuesInRange);
+        // every cell of the range counts, whether it was set or not
+        int rows = std::max(0, cells.getEndRow() - cells.getStartRow() + 1);
+        int cols = std::max(0, cells.getEndColumn() - cells.getStartColumn() + 1);
+        result = model.aggregateFromRange(cells, INDEX_SUM) / ((double) rows * cols);
     } else if (function == "SUM") {
-        result = sum(valuesInRange);
+        result = model.aggregateFromRange(cells, INDEX_SUM);
     } else if (function == "PRODUCT") {
-        result = product(valuesInRange);
+        result = model.aggregateFromRange(cells, INDEX_PRODUCT);
     } else if (function == "MAX") {
-        result = max(valuesInRange);
+        result = model.aggregateFromRange(cells, INDEX_MAX);
     } else if (function == "MIN") {
-        result = min(valuesInRange);
+        result = model.aggregateFromRange(cells, INDEX_MIN);
     } else if (function == "MEDIAN") {
-        result = median(valuesInRange);
+        result = model.percentileFromRange(cells, 0.5);
+    } else if (function == "PERCENTILE") {
+        result = model.percentileFromRange(cells, argument);
+    } else if (function == "QUARTILE") {
+        result = model.percentileFromRange(cells, argument / 4);
     } else if (function == "STDEV") {
-        result = stdev(valuesInRange);
+        result = model.stdevFromRange(cells);
     } else {
         error("Unknown function name: " + function);
     }
@@ -235,18 +268,26 @@ double RangeExp::eval(Spreadsheet& model) {
 }
 
 std::string RangeExp::getFunction() const{
-    return function;
+    return function.toString();
 }
 
 Range RangeExp::getRange() const{
     return cells;
 }
 
+double RangeExp::getArgument() const {
+    return argument;
+}
+
 ExpressionType RangeExp::getType() const {
     return RANGE;
 }
 
 std::string RangeExp::toString() const {
+    std::string function = this->function.toString();
+    if (Range::takesArgument(function)) {
+        return function + "(" + cells.toString() + ", " + realToString(argument) + ")";
+    }
     return function + "(" + cells.toString() + ")";
 }
 
@@ -257,16 +298,20 @@ std::string RangeExp::toString() const {
  * implementation of eval simply returns 0.0.
  */
 TextStringExp::TextStringExp(const std::string& str) {
-    this->str = str;
+    this->str.assign(str, getArena());
     setValue(0.0);
 }
 
+TextStringExp::~TextStringExp() {
+    str.release(getArena());
+}
+
 double TextStringExp::eval(Spreadsheet& /* model */) {
     return 0.0;
 }
 
 std::string TextStringExp::toString() const {
-    return str;
+    return str.toString();
 }
 
 ExpressionType TextStringExp::getType() const {
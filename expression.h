@@ -14,6 +14,7 @@
 #define _expression_h
 
 #include <string>
+#include "arena.h"
 #include "map.h"
 #include "set.h"
 #include "range.h"
@@ -50,8 +51,11 @@ enum ExpressionType {COMPOUND, DOUBLE, IDENTIFIER, RANGE, TEXTSTRING};
  *
  * The Expression class defines the interface common to all expressions;
  * each subclass provides its own implementation of the common interface.
+ *
+ * Expressions are ArenaObjects: the parser can build a tree in a sheet's
+ * arena, in which case the strings the nodes hold live there too.
  */
-class Expression {
+class Expression : public ArenaObject {
 public:
     /**
      * Specifies the constructor for the base Expression class.  Each subclass
@@ -148,8 +152,14 @@ public:
      */
     virtual const Expression* getRight() const;
 
+    /**
+     * Returns the cell referred to by an identifier expression, such as A2.
+     * If this expression is not an identifier expression, throws an ErrorException.
+     */
+    virtual CellRef getCellRef() const;
+
 private:
-    std::string rawText;
+    ArenaString rawText;
     double value;
 
     /**
@@ -208,7 +218,7 @@ public:
     virtual const Expression* getRight() const;
 
 private:
-    std::string op;    // the operator string (+, -, *, /)
+    ArenaString op;    // the operator string (+, -, *, /)
     Expression* lhs;
     Expression* rhs;   // the left and right subexpression
 
@@ -244,6 +254,9 @@ public:
     /** The constructor creates an identifier expression with the specified name. */
     IdentifierExp(const std::string& name);
 
+    /** Frees the memory for the name. */
+    virtual ~IdentifierExp();
+
     /** Returns the value of the referred cell by asking the spreadsheet. */
     virtual double eval(Spreadsheet& model);
 
@@ -253,8 +266,12 @@ public:
     /** Returns the identifier such as "A2". */
     virtual std::string toString() const;
 
+    /** Returns the cell referred to, such as A2. */
+    virtual CellRef getCellRef() const;
+
 private:
-    std::string name;   // the name of the identifier
+    ArenaString name;   // the name of the identifier
+    CellRef cell;       // the cell it names, parsed once up front
 };
 
 
@@ -270,6 +287,15 @@ public:
      */
     RangeExp(const std::string& function, Range cells);
 
+    /**
+     * Constructs a range expression for a function that also takes a number,
+     * such as "PERCENTILE", B2:B5 and 0.9.
+     */
+    RangeExp(const std::string& function, Range cells, double argument);
+
+    /** Frees the memory for the function name. */
+    virtual ~RangeExp();
+
     /**
      * Evaluates the expression by asking the spreadsheet for the values of
      * all cells in the range and then applying the given function to them.
@@ -279,7 +305,7 @@ public:
     /** Returns RANGE. */
     virtual ExpressionType getType() const;
 
-    /** Returns a string such as "AVERAGE(B2:B5)". */
+    /** Returns a string such as "AVERAGE(B2:B5)" or "PERCENTILE(B2:B5, 0.9)". */
     virtual std::string toString() const;
 
     /**
@@ -294,9 +320,16 @@ public:
      */
     virtual Range getRange() const;
 
+    /**
+     * Returns the number passed after the range, such as 0.9 for
+     * PERCENTILE(B2:B5, 0.9), or 0.0 if the function takes none.
+     */
+    double getArgument() const;
+
 private:
-    std::string function;
+    ArenaString function;
     Range cells;
+    double argument;
 };
 
 
@@ -308,6 +341,9 @@ public:
     /** The constructor creates a new text string constant expression. */
     TextStringExp(const std::string& str);
 
+    /** Frees the memory for the string. */
+    virtual ~TextStringExp();
+
     /** Returns 0.0 because strings have no numeric value. */
     double eval(Spreadsheet& model);
 
@@ -318,7 +354,7 @@ public:
     std::string toString() const;
 
 private:
-    std::string str;   // the value of the text string constant
+    ArenaString str;   // the value of the text string constant
 };
 
 
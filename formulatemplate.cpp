@@ -0,0 +1,150 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the formulatemplate.h interface.
+ */
+
+#include "formulatemplate.h"
+#include <cctype>
+#include <cstdlib>
+#include "lexer.h"
+#include "strlib.h"
+
+namespace {
+
+// a formula is text whose first token is "=", as the parser sees it
+bool isFormulaText(const std::string& text) {
+    for (char ch : text) {
+        if (!isspace((unsigned char) ch)) {
+            return ch == '=';
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+FormulaTemplate::FormulaTemplate(Expression* exp, const CellRef& origin, const std::string& key)
+        : exp(exp),
+          program(nullptr),
+          origin(origin),
+          userCount(1) {
+    this->key.assign(key, getArena());
+    program = new (getArena()) Program(exp);
+}
+
+FormulaTemplate::~FormulaTemplate() {
+    delete program;
+    delete exp;
+    key.release(getArena());
+}
+
+std::string FormulaTemplate::normalize(const std::string& rawText, const CellRef& cell) {
+    if (!isFormulaText(rawText)) {
+        return rawText;
+    }
+    std::string result;
+    result.reserve(rawText.length() + 8);
+    Lexer lexer(rawText);
+    const char* copied = rawText.data();
+    bool absolute = false;
+    for (Token token = lexer.nextToken(); token.type != Token::END; token = lexer.nextToken()) {
+        // the spaces before the token are kept as they are
+        result.append(copied, token.text);
+        copied = token.text + token.length;
+
+        // a cell name is replaced only if it is written the canonical way;
+        // others, such as "a1", are kept and tie the key to this cell
+        CellRef ref;
+        if (token.type == Token::WORD && CellRef::parse(token.text, copied, ref)
+                && ref.toString().compare(0, std::string::npos, token.text, token.length) == 0) {
+            result += "{" + integerToString(ref.getRow() - cell.getRow())
+                    + "," + integerToString(ref.getColumn() - cell.getColumn()) + "}";
+        } else {
+            absolute = absolute || (token.type == Token::WORD && ref.isValid());
+            for (const char* p = token.text; p < copied; p++) {
+                if (*p == '{') result += '{';
+                result += *p;
+            }
+        }
+    }
+    result.append(copied, rawText.data() + rawText.length());
+    if (absolute) {
+        result += "{@" + cell.toString() + "}";
+    }
+    return result;
+}
+
+const Expression* FormulaTemplate::getExpression() const {
+    return exp;
+}
+
+std::string FormulaTemplate::getKey() const {
+    return key.toString();
+}
+
+const Program* FormulaTemplate::getProgram() const {
+    return program;
+}
+
+double FormulaTemplate::run(Spreadsheet& model, const CellNode* cell) const {
+    return program->run(model, cell->bindings,
+                        cell->ref.getRow() - origin.getRow(),
+                        cell->ref.getColumn() - origin.getColumn());
+}
+
+void FormulaTemplate::runBatch(Spreadsheet& model, const CellGrid& grid, const CellNode* first,
+                               int count, double* results) const {
+    program->runBatch(model, grid, count,
+                      first->ref.getRow() - origin.getRow(),
+                      first->ref.getColumn() - origin.getColumn(), results);
+}
+
+std::string FormulaTemplate::getRawText(const CellRef& cell) const {
+    // undo normalize: each "{dr,dc}" becomes the name of that cell, and a
+    // final "{@cell}" is dropped
+    std::string text = key.toString();
+    if (!isFormulaText(text)) {
+        return text;
+    }
+    std::string result;
+    result.reserve(text.length());
+    size_t n = text.length();
+    for (size_t i = 0; i < n; i++) {
+        if (text[i] != '{') {
+            result += text[i];
+        } else if (i + 1 < n && text[i + 1] == '{') {
+            result += '{';
+            i++;
+        } else if (i + 1 < n && text[i + 1] == '@') {
+            break;
+        } else {
+            char* end;
+            long dr = strtol(text.c_str() + i + 1, &end, 10);
+            long dc = strtol(end + 1, &end, 10);
+            result += CellRef(cell.getRow() + (int) dr, cell.getColumn() + (int) dc).toString();
+            i = end - text.c_str();
+        }
+    }
+    return result;
+}
+
+CellRef FormulaTemplate::shift(const CellRef& ref, const CellRef& cell) const {
+    return CellRef(ref.getRow() + cell.getRow() - origin.getRow(),
+                   ref.getColumn() + cell.getColumn() - origin.getColumn());
+}
+
+Range FormulaTemplate::shift(const Range& range, const CellRef& cell) const {
+    return Range(shift(range.getStart(), cell), shift(range.getEnd(), cell));
+}
+
+void FormulaTemplate::addUser() {
+    userCount++;
+}
+
+int FormulaTemplate::removeUser() {
+    return --userCount;
+}
+
+int FormulaTemplate::getUserCount() const {
+    return userCount;
+}
@@ -0,0 +1,125 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the FormulaTemplate type, which lets every cell whose
+ * formula is the same relative to its own position share one parsed and
+ * compiled copy of it.
+ */
+
+#ifndef _formulatemplate_h
+#define _formulatemplate_h
+
+#include <string>
+#include "arena.h"
+#include "cellgrid.h"
+#include "cellref.h"
+#include "expression.h"
+#include "program.h"
+#include "range.h"
+
+/**
+ * A formula written relative to the cell holding it, in the manner of R1C1
+ * notation: "=A2*B2" in C2 and "=A3*B3" in C3 are both "the cell two to the
+ * left times the cell one to the left".  A template keeps the expression
+ * tree and compiled program of the first cell that used it (its origin);
+ * any other cell reads them shifted by its offset from the origin, and only
+ * needs its own array of bound precedents.
+ *
+ * Cells are matched by their normalized text (see normalize), which also
+ * lets a template give back each cell's exact raw text.  Text that is not a
+ * formula is normalized to itself, so equal constants share a template too.
+ */
+class FormulaTemplate : public ArenaObject {
+public:
+    /**
+     * Constructs a template from the given expression, parsed from the text
+     * of the origin cell, and the normalized text of that cell.  The template
+     * takes ownership of the expression.
+     */
+    FormulaTemplate(Expression* exp, const CellRef& origin, const std::string& key);
+
+    /**
+     * Frees the expression and the program.
+     */
+    ~FormulaTemplate();
+
+    /**
+     * Returns rawText as entered in the given cell with each canonical cell
+     * name of a formula replaced by its offset from the cell, such as
+     * "={0,-2}*{0,-1}" for "=A2*B2" in C2; literal braces are doubled.
+     * A formula that names a cell any other way, such as "=a1+1", only has
+     * the same shape as itself in the same cell, so its text is kept and
+     * the cell is added at the end, as in "=a1+1{@C2}".  Other text is
+     * returned unchanged.  Texts with the same normalized form parse to the
+     * same expression shifted by the offset between their cells, so a cell
+     * can use the template of an equal key without being parsed.  Throws an
+     * ErrorException if the text has an unterminated string.
+     */
+    static std::string normalize(const std::string& rawText, const CellRef& cell);
+
+    /**
+     * Returns the expression of the origin cell.  Cell names and ranges in
+     * it must be shifted with shift to apply to another cell.
+     */
+    const Expression* getExpression() const;
+
+    /**
+     * Returns the key this template was made with.
+     */
+    std::string getKey() const;
+
+    /**
+     * Returns the compiled formula.
+     */
+    const Program* getProgram() const;
+
+    /**
+     * Evaluates the formula for the given cell, whose bindings hold the nodes
+     * of the cells named by getProgram, shifted to it.
+     */
+    double run(Spreadsheet& model, const CellNode* cell) const;
+
+    /**
+     * Evaluates the formula for a run of count cells, one below the other
+     * in one column starting at the given cell, storing their values in
+     * results; see Program::runBatch for what the run must satisfy.
+     */
+    void runBatch(Spreadsheet& model, const CellGrid& grid, const CellNode* first,
+                  int count, double* results) const;
+
+    /**
+     * Returns the raw text of the formula as entered in the given cell.
+     */
+    std::string getRawText(const CellRef& cell) const;
+
+    /**
+     * Returns the given cell name or range of the origin's expression as
+     * seen from the given cell.
+     */
+    CellRef shift(const CellRef& ref, const CellRef& cell) const;
+    Range shift(const Range& range, const CellRef& cell) const;
+
+    /**
+     * Counts one more or one fewer cell using this template.  removeUser
+     * returns the number left; the owner frees the template when it is 0.
+     */
+    void addUser();
+    int removeUser();
+
+    /**
+     * Returns the number of cells using this template.
+     */
+    int getUserCount() const;
+
+private:
+    Expression* exp;
+    Program* program;
+    CellRef origin;
+    ArenaString key;
+    int userCount;
+
+    // templates are not copyable
+    FormulaTemplate(const FormulaTemplate&);
+    FormulaTemplate& operator =(const FormulaTemplate&);
+};
+
+#endif // _formulatemplate_h
@@ -0,0 +1,552 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the journal.h interface.
+ */
+
+#include "journal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "checksum.h"
+#include "error.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// a journal starts with these 8 characters and a 4-byte version number
+const char JOURNAL_MAGIC[8] = {'S', '1', '2', '3', 'J', 'R', 'N', 'L'};
+const uint32_t JOURNAL_VERSION = 1;
+const size_t JOURNAL_HEADER_SIZE = 12;
+
+// each record starts with its length and checksum, 4 bytes each
+const size_t RECORD_HEADER_SIZE = 8;
+
+std::string journalName(const std::string& filename) {
+    return filename + ".journal";
+}
+
+std::string oldJournalName(const std::string& filename) {
+    return filename + ".journal.old";
+}
+
+/*
+ * Numbers are written in little-endian order whatever the machine, and
+ * cell coordinates as variable-length integers: 7 bits a byte, lowest
+ * first, with the high bit set on every byte but the last.
+ */
+void putUint32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += (char) ((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint32_t getUint32(const char* p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) (unsigned char) p[i] << (8 * i);
+    }
+    return value;
+}
+
+void putVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += (char) ((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += (char) value;
+}
+
+bool getVarint(const char*& p, const char* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 32 && p < end; shift += 7) {
+        unsigned char byte = (unsigned char) *p++;
+        value |= (uint32_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string journalHeader() {
+    std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    putUint32(header, JOURNAL_VERSION);
+    return header;
+}
+
+bool fileExists(const std::string& path) {
+    std::ifstream infile(path.c_str(), std::ios_base::binary);
+    return !infile.fail();
+}
+
+// reads the whole file, or returns false if it cannot be opened
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream infile(path.c_str(), std::ios_base::binary);
+    if (infile.fail()) {
+        return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/*
+ * Reads the records of the journal at path into records, if it is not
+ * nullptr, and returns the length of the file up to the end of its last
+ * complete record; 0 if it has no complete header.  If cleared is not
+ * nullptr it is set to the length up to the end of the last clear record,
+ * or 0 if there is none.  A record whose length runs past the end of the
+ * file or whose checksum does not match was cut short by a crash, and ends
+ * the journal.
+ */
+size_t readJournal(const std::string& path, std::vector<JournalRecord>* records,
+                   size_t* cleared = nullptr) {
+    if (cleared != nullptr) {
+        *cleared = 0;
+    }
+    std::string contents;
+    if (!readFile(path, contents) || contents.length() < JOURNAL_HEADER_SIZE) {
+        return 0;
+    }
+    if (memcmp(contents.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+            || getUint32(contents.data() + sizeof(JOURNAL_MAGIC)) != JOURNAL_VERSION) {
+        error("Journal: not a journal: " + path);
+    }
+    size_t valid = JOURNAL_HEADER_SIZE;
+    while (contents.length() - valid >= RECORD_HEADER_SIZE) {
+        const char* header = contents.data() + valid;
+        uint32_t length = getUint32(header);
+        if (length == 0 || length > contents.length() - valid - RECORD_HEADER_SIZE
+                || computeCrc32(header + RECORD_HEADER_SIZE, length) != getUint32(header + 4)) {
+            break;
+        }
+        const char* p = header + RECORD_HEADER_SIZE;
+        const char* end = p + length;
+        JournalRecord record;
+        record.type = (JournalRecord::Type) (unsigned char) *p++;
+        if (record.type == JournalRecord::SET_CELL) {
+            uint32_t row;
+            uint32_t column;
+            if (!getVarint(p, end, row) || !getVarint(p, end, column)) {
+                break;
+            }
+            record.cell = CellRef((int) row, (int) column);
+            record.rawText.assign(p, end);
+        } else if (record.type != JournalRecord::CLEAR) {
+            break;
+        }
+        if (records != nullptr) {
+            records->push_back(record);
+        }
+        valid += RECORD_HEADER_SIZE + length;
+        if (record.type == JournalRecord::CLEAR && cleared != nullptr) {
+            *cleared = valid;
+        }
+    }
+    return valid;
+}
+
+/*
+ * Thin wrappers over the platform's unbuffered file calls; each throws an
+ * ErrorException naming the file when it fails.
+ */
+#ifdef _WIN32
+
+int openFile(const std::string& path) {
+    int fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd < 0) {
+        error("Journal: cannot open " + path);
+    }
+    _lseek(fd, 0, SEEK_END);
+    return fd;
+}
+
+void writeFile(int fd, const std::string& data, const std::string& path) {
+    size_t written = 0;
+    while (written < data.length()) {
+        int count = _write(fd, data.data() + written, (unsigned int) (data.length() - written));
+        if (count <= 0) {
+            error("Journal: cannot write " + path);
+        }
+        written += count;
+    }
+}
+
+void truncateFile(int fd, size_t length, const std::string& path) {
+    if (_chsize(fd, (long) length) != 0) {
+        error("Journal: cannot truncate " + path);
+    }
+    _lseek(fd, (long) length, SEEK_SET);
+}
+
+void syncFile(int fd) {
+    _commit(fd);
+}
+
+void closeFile(int fd) {
+    _close(fd);
+}
+
+void replaceFile(const std::string& from, const std::string& to) {
+    // rename cannot replace a file here, so there is a moment with neither
+    std::remove(to.c_str());
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        error("Journal: cannot rename " + from);
+    }
+}
+
+void syncDirectory(const std::string& /* path */) {
+    // renames are made durable by the file system itself
+}
+
+#else
+
+int openFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        error("Journal: cannot open " + path);
+    }
+    lseek(fd, 0, SEEK_END);
+    return fd;
+}
+
+void writeFile(int fd, const std::string& data, const std::string& path) {
+    size_t written = 0;
+    while (written < data.length()) {
+        ssize_t count = write(fd, data.data() + written, data.length() - written);
+        if (count <= 0) {
+            error("Journal: cannot write " + path);
+        }
+        written += count;
+    }
+}
+
+void truncateFile(int fd, size_t length, const std::string& path) {
+    if (ftruncate(fd, (off_t) length) != 0) {
+        error("Journal: cannot truncate " + path);
+    }
+    lseek(fd, (off_t) length, SEEK_SET);
+}
+
+void syncFile(int fd) {
+    fsync(fd);
+}
+
+void closeFile(int fd) {
+    close(fd);
+}
+
+void replaceFile(const std::string& from, const std::string& to) {
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        error("Journal: cannot rename " + from);
+    }
+}
+
+void syncDirectory(const std::string& path) {
+    // a rename only survives a crash once the directory holding it is synced
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+#endif // _WIN32
+
+} // namespace
+
+const int Journal::SYNC_INTERVAL;
+
+Journal::Journal(const std::string& filename)
+        : filename(filename),
+          fd(-1),
+          size(0),
+          unsynced(false),
+          syncing(false),
+          torn(false),
+          compacting(false),
+          snapshotDropped(false),
+          stopping(false) {
+    // drop whatever a crash left after the last complete record
+    std::string path = journalName(filename);
+    size_t valid = readJournal(path, nullptr);
+    fd = openFile(path);
+    try {
+        if (valid == 0) {
+            truncateFile(fd, 0, path);
+            writeFile(fd, journalHeader(), path);
+            valid = JOURNAL_HEADER_SIZE;
+        } else {
+            truncateFile(fd, valid, path);
+        }
+    } catch (ErrorException&) {
+        closeFile(fd);
+        throw;
+    }
+    syncFile(fd);
+    size = valid - JOURNAL_HEADER_SIZE;
+    worker = std::thread(&Journal::runWorker, this);
+}
+
+Journal::~Journal() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        // a snapshot that failed after a clear gets one more try
+        if (snapshotDropped && !compacting) {
+            compacting = true;
+        }
+    }
+    changed.notify_all();
+    worker.join();
+    try {
+        commit();
+    } catch (ErrorException&) {
+        // nothing more can be done with records that cannot be written
+    }
+    syncFile(fd);
+    closeFile(fd);
+}
+
+void Journal::readRecords(const std::string& filename, std::vector<JournalRecord>& records) {
+    readJournal(oldJournalName(filename), &records);
+    readJournal(journalName(filename), &records);
+}
+
+void Journal::appendSetCell(const CellRef& cell, const std::string& rawText) {
+    std::string record;
+    record += (char) JournalRecord::SET_CELL;
+    putVarint(record, (uint32_t) cell.getRow());
+    putVarint(record, (uint32_t) cell.getColumn());
+    record += rawText;
+    putUint32(pending, (uint32_t) record.length());
+    putUint32(pending, computeCrc32(record.data(), record.length()));
+    pending += record;
+}
+
+void Journal::appendClear() {
+    char record = (char) JournalRecord::CLEAR;
+    putUint32(pending, 1);
+    putUint32(pending, computeCrc32(&record, 1));
+    pending += record;
+}
+
+void Journal::commit() {
+    // one write for the whole group, synced later by the worker; a group
+    // that cannot be written is dropped whole, cutting off any part of it
+    // that reached the file, so that the caller can undo it in memory
+    if (pending.empty()) return;
+    std::string group;
+    group.swap(pending);
+    std::unique_lock<std::mutex> guard(lock);
+    // with the old snapshot dropped, records belong on top of the one being
+    // written, and have nothing to go on until it is in place; if writing it
+    // failed, nothing has been committed since, so it is written again
+    changed.wait(guard, [this] { return !snapshotDropped || !compacting; });
+    if (snapshotDropped && !stopping) {
+        compacting = true;
+        changed.notify_all();
+        changed.wait(guard, [this] { return !compacting; });
+    }
+    if (snapshotDropped) {
+        error("Journal: the snapshot of " + filename + " has not been written");
+    }
+    std::string path = journalName(filename);
+    if (torn) {
+        truncateFile(fd, JOURNAL_HEADER_SIZE + size, path);
+        torn = false;
+    }
+    try {
+        writeFile(fd, group, path);
+    } catch (ErrorException&) {
+        // the next commit cuts it off if this cannot
+        torn = true;
+        try {
+            truncateFile(fd, JOURNAL_HEADER_SIZE + size, path);
+            torn = false;
+        } catch (ErrorException&) {
+        }
+        throw;
+    }
+    size += group.length();
+    unsynced = true;
+}
+
+void Journal::sync() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return !syncing; });
+    if (unsynced) {
+        syncFile(fd);
+        unsynced = false;
+    }
+}
+
+size_t Journal::getSize() const {
+    return size + pending.length();
+}
+
+void Journal::compact(const std::string& snapshot) {
+    waitForCompaction();
+    commit();
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return !syncing; });
+    rotate();
+    this->snapshot = snapshot;
+    compacting = true;
+    changed.notify_all();
+}
+
+void Journal::waitForCompaction() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return !compacting; });
+    if (!failure.empty()) {
+        std::string message = failure;
+        failure.clear();
+        error(message);
+    }
+}
+
+void Journal::rotate() {
+    // move every record so far into the old journal, which the compaction
+    // deletes once the snapshot holding them is in place
+    std::string path = journalName(filename);
+    std::string oldPath = oldJournalName(filename);
+    syncFile(fd);
+    unsynced = false;
+    size_t cleared;
+    size_t valid = readJournal(path, nullptr, &cleared);
+    if (cleared > 0) {
+        // a clear must not reach the old journal, where replaying it would
+        // also empty the new snapshot; the snapshot it emptied and every
+        // record before it are dropped now instead, and only the records
+        // after it are kept, in a new old journal swapped in whole
+        std::string contents;
+        if (!readFile(path, contents)) {
+            error("Journal: cannot read " + path);
+        }
+        std::remove(filename.c_str());
+        syncDirectory(filename);
+        std::string temporary = oldPath + ".tmp";
+        int oldFd = openFile(temporary);
+        try {
+            truncateFile(oldFd, 0, temporary);
+            writeFile(oldFd, journalHeader() + contents.substr(cleared, valid - cleared),
+                      temporary);
+        } catch (ErrorException&) {
+            closeFile(oldFd);
+            throw;
+        }
+        syncFile(oldFd);
+        closeFile(oldFd);
+        replaceFile(temporary, oldPath);
+        syncDirectory(oldPath);
+        truncateFile(fd, JOURNAL_HEADER_SIZE, path);
+        syncFile(fd);
+        snapshotDropped = true;
+    } else if (fileExists(oldPath)) {
+        // an earlier compaction did not finish, so its old journal is still
+        // needed; add these records to the end of it
+        std::string contents;
+        if (!readFile(path, contents)) {
+            error("Journal: cannot read " + path);
+        }
+        size_t oldValid = readJournal(oldPath, nullptr);
+        int oldFd = openFile(oldPath);
+        try {
+            truncateFile(oldFd, oldValid, oldPath);
+            writeFile(oldFd, contents.substr(JOURNAL_HEADER_SIZE), oldPath);
+        } catch (ErrorException&) {
+            closeFile(oldFd);
+            throw;
+        }
+        syncFile(oldFd);
+        closeFile(oldFd);
+        truncateFile(fd, JOURNAL_HEADER_SIZE, path);
+        syncFile(fd);
+    } else {
+        closeFile(fd);
+        fd = -1;
+        replaceFile(path, oldPath);
+        fd = openFile(path);
+        truncateFile(fd, 0, path);
+        writeFile(fd, journalHeader(), path);
+        syncFile(fd);
+        syncDirectory(path);
+    }
+    size = 0;
+    torn = false;
+}
+
+void Journal::runWorker() {
+    // sync the journal every SYNC_INTERVAL while commits come in, and write
+    // each compacted snapshot; a pending compaction is finished on stopping
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        if (unsynced) {
+            unsynced = false;
+            syncing = true;
+            int file = fd;
+            guard.unlock();
+            syncFile(file);
+            guard.lock();
+            syncing = false;
+            changed.notify_all();
+        }
+        if (compacting) {
+            std::string contents;
+            contents.swap(snapshot);
+            guard.unlock();
+            std::string message;
+            try {
+                writeSnapshot(contents);
+            } catch (ErrorException& ex) {
+                message = ex.getMessage();
+            }
+            guard.lock();
+            failure = message;
+            if (message.empty()) {
+                snapshotDropped = false;
+            } else if (snapshotDropped) {
+                // kept for the next commit to try again
+                snapshot.swap(contents);
+            }
+            compacting = false;
+            changed.notify_all();
+            continue;
+        }
+        if (stopping) break;
+        changed.wait_for(guard, std::chrono::milliseconds(SYNC_INTERVAL),
+                         [this] { return stopping || compacting; });
+    }
+}
+
+void Journal::writeSnapshot(const std::string& snapshot) {
+    // write the snapshot beside the old one and swap it in, so that a crash
+    // leaves one or the other whole; only then is the old journal unneeded
+    std::string temporary = filename + ".tmp";
+    int file = openFile(temporary);
+    try {
+        truncateFile(file, 0, temporary);
+        writeFile(file, snapshot, temporary);
+    } catch (ErrorException&) {
+        closeFile(file);
+        throw;
+    }
+    syncFile(file);
+    closeFile(file);
+    replaceFile(temporary, filename);
+    syncDirectory(filename);
+    std::remove(oldJournalName(filename).c_str());
+    syncDirectory(filename);
+}
@@ -0,0 +1,144 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the Journal type, an append-only log of the changes
+ * made to a sheet since its last snapshot, which lets the sheet be saved a
+ * change at a time and brought back after a crash.
+ */
+
+#ifndef _journal_h
+#define _journal_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cellref.h"
+
+/**
+ * One change recorded in a journal: a cell set to some raw text, or the
+ * whole sheet cleared.
+ */
+struct JournalRecord {
+    enum Type {SET_CELL = 1, CLEAR = 2};
+
+    Type type;
+    CellRef cell;           // the cell set, for SET_CELL
+    std::string rawText;    // its new text, for SET_CELL
+};
+
+/**
+ * The journal kept beside a snapshot file, such as "sheet.s123": the file
+ * "sheet.s123.journal" holds every change made since the snapshot, and
+ * "sheet.s123.journal.old" the changes made before a compaction began, for
+ * as long as it runs.  Applying the records of both, in that order and as
+ * one batch, to the snapshot gives the sheet as it was last committed.
+ * Setting a cell to the same text twice changes nothing, so records that
+ * are already part of the snapshot may safely be applied again.  Clearing
+ * the sheet is the exception, so a clear never reaches the old journal: a
+ * compaction deletes the snapshot the clear emptied and drops the records
+ * before it instead.  Until the compacted snapshot is in place, commits
+ * wait for it, as the records they write would go on top of nothing, and
+ * write it again if it failed.
+ *
+ * Each record is a length, a CRC-32 checksum and the record itself, so a
+ * record cut short by a crash is found and dropped.  Records are written
+ * with one write per commit, which survives the process crashing; a
+ * background thread calls fsync on the file at most SYNC_INTERVAL later,
+ * so that a whole group of commits reaches the disk with one sync.  The
+ * same thread writes the compacted snapshot, so compacting only costs the
+ * caller the time to serialize the sheet into memory.
+ */
+class Journal {
+public:
+    /**
+     * Opens the journal of the given snapshot file for appending, creating
+     * it if needed and dropping any record cut short at its end.
+     * Throws an ErrorException if it cannot be opened.
+     */
+    Journal(const std::string& filename);
+
+    /**
+     * Finishes any compaction, syncs the journal and closes it.
+     */
+    ~Journal();
+
+    /**
+     * Appends every complete record of the journal of the given snapshot
+     * file to records, in the order they were written.
+     */
+    static void readRecords(const std::string& filename, std::vector<JournalRecord>& records);
+
+    /**
+     * Adds a record to the group that the next call to commit writes.
+     */
+    void appendSetCell(const CellRef& cell, const std::string& rawText);
+    void appendClear();
+
+    /**
+     * Writes the records appended since the last commit to the file.
+     * Throws an ErrorException if they cannot be written, or if the
+     * snapshot a clear left to a compaction still cannot be, in which case
+     * none of them are kept.
+     */
+    void commit();
+
+    /**
+     * Syncs everything committed so far to the disk before returning.
+     */
+    void sync();
+
+    /**
+     * Returns the number of bytes in the journal since the last compaction.
+     */
+    size_t getSize() const;
+
+    /**
+     * Starts replacing the snapshot file with the given contents, which
+     * must hold the sheet with every committed record applied, and starts
+     * a new journal for the changes made from now on.  The snapshot is
+     * written and synced in the background; the old journal is deleted once
+     * it is in place.  Throws an ErrorException if the previous compaction
+     * failed.
+     */
+    void compact(const std::string& snapshot);
+
+    /**
+     * Waits for a compaction in progress to finish.  Throws an
+     * ErrorException if it failed.
+     */
+    void waitForCompaction();
+
+    /* How long a commit may wait to be synced, in milliseconds. */
+    static const int SYNC_INTERVAL = 50;
+
+private:
+    void rotate();
+    void runWorker();
+    void writeSnapshot(const std::string& snapshot);
+
+    std::string filename;       // the snapshot file
+    int fd;
+    std::string pending;
+    size_t size;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread worker;
+    bool unsynced;              // committed but not yet synced
+    bool syncing;               // the worker is syncing fd
+    bool torn;                  // part of a failed commit is left in fd
+    bool compacting;
+    bool snapshotDropped;       // by a clear, until a compaction replaces it
+    std::string snapshot;       // contents for the compaction to write
+    std::string failure;        // why the last compaction failed
+    bool stopping;
+
+    // journals are not copyable
+    Journal(const Journal&);
+    Journal& operator =(const Journal&);
+};
+
+#endif // _journal_h
@@ -0,0 +1,482 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the kernels.h interface.
+ *
+ * The compensated sums below rely on the compiler keeping floating-point
+ * operations in the order they are written, so this file must not be built
+ * with -ffast-math or similar flags.
+ */
+
+#include "kernels.h"
+#include <cmath>
+#include "error.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum SimdLevel {SIMD_NONE, SIMD_SSE2, SIMD_AVX};
+
+SimdLevel detectSimdLevel() {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return SIMD_AVX;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_NONE;
+}
+
+// the widest vectors this processor supports, checked once
+SimdLevel simdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+/*
+ * One step of Kahan summation: error holds the part of earlier values that
+ * did not fit in sum, which is subtracted from the next value before it is
+ * added.  The true total is sum - error.
+ */
+inline void addCompensated(double& sum, double& error, double value) {
+    double adjusted = value - error;
+    double total = sum + adjusted;
+    error = (total - sum) - adjusted;
+    sum = total;
+}
+
+// the value added to a sum: the value itself, or its squared distance from
+// the center when summing squares
+template <bool SQUARES>
+inline double term(double value, double center) {
+    if (SQUARES) {
+        double distance = value - center;
+        return distance * distance;
+    }
+    return value;
+}
+
+/*
+ * The vector kernels below each handle the longest prefix of the values
+ * that fills all of their accumulators, fold their lanes into the scalar
+ * state passed in, and return the number of values they used; the callers
+ * finish off the rest one value at a time.
+ */
+
+#ifdef KERNELS_X86
+
+template <bool SQUARES>
+__attribute__((target("avx")))
+inline void addCompensatedAvx(__m256d& sum, __m256d& error, __m256d value, __m256d center) {
+    if (SQUARES) {
+        value = _mm256_sub_pd(value, center);
+        value = _mm256_mul_pd(value, value);
+    }
+    __m256d adjusted = _mm256_sub_pd(value, error);
+    __m256d total = _mm256_add_pd(sum, adjusted);
+    error = _mm256_sub_pd(_mm256_sub_pd(total, sum), adjusted);
+    sum = total;
+}
+
+template <bool SQUARES>
+__attribute__((target("avx")))
+int sumAvx(const double* values, int count, double center, double& sum, double& error) {
+    // four vectors of four lanes, each lane its own compensated sum
+    __m256d c = _mm256_set1_pd(center);
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m256d e0 = s0, e1 = s0, e2 = s0, e3 = s0;
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        addCompensatedAvx<SQUARES>(s0, e0, _mm256_loadu_pd(values + i), c);
+        addCompensatedAvx<SQUARES>(s1, e1, _mm256_loadu_pd(values + i + 4), c);
+        addCompensatedAvx<SQUARES>(s2, e2, _mm256_loadu_pd(values + i + 8), c);
+        addCompensatedAvx<SQUARES>(s3, e3, _mm256_loadu_pd(values + i + 12), c);
+    }
+    double sums[16], errors[16];
+    _mm256_storeu_pd(sums, s0);
+    _mm256_storeu_pd(sums + 4, s1);
+    _mm256_storeu_pd(sums + 8, s2);
+    _mm256_storeu_pd(sums + 12, s3);
+    _mm256_storeu_pd(errors, e0);
+    _mm256_storeu_pd(errors + 4, e1);
+    _mm256_storeu_pd(errors + 8, e2);
+    _mm256_storeu_pd(errors + 12, e3);
+    for (int lane = 0; lane < 16; lane++) {
+        addCompensated(sum, error, sums[lane]);
+        addCompensated(sum, error, -errors[lane]);
+    }
+    return i;
+}
+
+__attribute__((target("avx")))
+int productAvx(const double* values, int count, double& product) {
+    __m256d p0 = _mm256_set1_pd(1.0), p1 = p0, p2 = p0, p3 = p0;
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        p0 = _mm256_mul_pd(p0, _mm256_loadu_pd(values + i));
+        p1 = _mm256_mul_pd(p1, _mm256_loadu_pd(values + i + 4));
+        p2 = _mm256_mul_pd(p2, _mm256_loadu_pd(values + i + 8));
+        p3 = _mm256_mul_pd(p3, _mm256_loadu_pd(values + i + 12));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_mul_pd(_mm256_mul_pd(p0, p1), _mm256_mul_pd(p2, p3)));
+    for (int lane = 0; lane < 4; lane++) {
+        product *= lanes[lane];
+    }
+    return i;
+}
+
+/*
+ * minpd and maxpd return their second operand when the two are equal or
+ * either is NaN, so min(value, best) is exactly "value < best ? value :
+ * best", the step of the scalar loop.  Every lane starts from the first
+ * value, so a lane only holds NaN when the scalar loop would.
+ */
+template <bool MAXIMUM>
+__attribute__((target("avx")))
+int extremeAvx(const double* values, int count, double& best) {
+    __m256d b0 = _mm256_set1_pd(best), b1 = b0, b2 = b0, b3 = b0;
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        if (MAXIMUM) {
+            b0 = _mm256_max_pd(_mm256_loadu_pd(values + i), b0);
+            b1 = _mm256_max_pd(_mm256_loadu_pd(values + i + 4), b1);
+            b2 = _mm256_max_pd(_mm256_loadu_pd(values + i + 8), b2);
+            b3 = _mm256_max_pd(_mm256_loadu_pd(values + i + 12), b3);
+        } else {
+            b0 = _mm256_min_pd(_mm256_loadu_pd(values + i), b0);
+            b1 = _mm256_min_pd(_mm256_loadu_pd(values + i + 4), b1);
+            b2 = _mm256_min_pd(_mm256_loadu_pd(values + i + 8), b2);
+            b3 = _mm256_min_pd(_mm256_loadu_pd(values + i + 12), b3);
+        }
+    }
+    double lanes[16];
+    _mm256_storeu_pd(lanes, b0);
+    _mm256_storeu_pd(lanes + 4, b1);
+    _mm256_storeu_pd(lanes + 8, b2);
+    _mm256_storeu_pd(lanes + 12, b3);
+    for (int lane = 0; lane < 16; lane++) {
+        if (MAXIMUM ? lanes[lane] > best : lanes[lane] < best) {
+            best = lanes[lane];
+        }
+    }
+    return i;
+}
+
+// one elementwise operator, op being one of + - * /
+template <char OP>
+__attribute__((target("avx")))
+inline __m256d applyAvx(__m256d left, __m256d right) {
+    switch (OP) {
+    case '+': return _mm256_add_pd(left, right);
+    case '-': return _mm256_sub_pd(left, right);
+    case '*': return _mm256_mul_pd(left, right);
+    default:  return _mm256_div_pd(left, right);
+    }
+}
+
+template <char OP>
+__attribute__((target("avx")))
+int elementwiseAvx(const double* left, const double* right, double* result, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d r0 = applyAvx<OP>(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i));
+        __m256d r1 = applyAvx<OP>(_mm256_loadu_pd(left + i + 4), _mm256_loadu_pd(right + i + 4));
+        _mm256_storeu_pd(result + i, r0);
+        _mm256_storeu_pd(result + i + 4, r1);
+    }
+    return i;
+}
+
+template <bool SQUARES>
+__attribute__((target("sse2")))
+inline void addCompensatedSse2(__m128d& sum, __m128d& error, __m128d value, __m128d center) {
+    if (SQUARES) {
+        value = _mm_sub_pd(value, center);
+        value = _mm_mul_pd(value, value);
+    }
+    __m128d adjusted = _mm_sub_pd(value, error);
+    __m128d total = _mm_add_pd(sum, adjusted);
+    error = _mm_sub_pd(_mm_sub_pd(total, sum), adjusted);
+    sum = total;
+}
+
+template <bool SQUARES>
+__attribute__((target("sse2")))
+int sumSse2(const double* values, int count, double center, double& sum, double& error) {
+    // four vectors of two lanes, each lane its own compensated sum
+    __m128d c = _mm_set1_pd(center);
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    __m128d e0 = s0, e1 = s0, e2 = s0, e3 = s0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        addCompensatedSse2<SQUARES>(s0, e0, _mm_loadu_pd(values + i), c);
+        addCompensatedSse2<SQUARES>(s1, e1, _mm_loadu_pd(values + i + 2), c);
+        addCompensatedSse2<SQUARES>(s2, e2, _mm_loadu_pd(values + i + 4), c);
+        addCompensatedSse2<SQUARES>(s3, e3, _mm_loadu_pd(values + i + 6), c);
+    }
+    double sums[8], errors[8];
+    _mm_storeu_pd(sums, s0);
+    _mm_storeu_pd(sums + 2, s1);
+    _mm_storeu_pd(sums + 4, s2);
+    _mm_storeu_pd(sums + 6, s3);
+    _mm_storeu_pd(errors, e0);
+    _mm_storeu_pd(errors + 2, e1);
+    _mm_storeu_pd(errors + 4, e2);
+    _mm_storeu_pd(errors + 6, e3);
+    for (int lane = 0; lane < 8; lane++) {
+        addCompensated(sum, error, sums[lane]);
+        addCompensated(sum, error, -errors[lane]);
+    }
+    return i;
+}
+
+__attribute__((target("sse2")))
+int productSse2(const double* values, int count, double& product) {
+    __m128d p0 = _mm_set1_pd(1.0), p1 = p0, p2 = p0, p3 = p0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        p0 = _mm_mul_pd(p0, _mm_loadu_pd(values + i));
+        p1 = _mm_mul_pd(p1, _mm_loadu_pd(values + i + 2));
+        p2 = _mm_mul_pd(p2, _mm_loadu_pd(values + i + 4));
+        p3 = _mm_mul_pd(p3, _mm_loadu_pd(values + i + 6));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_mul_pd(_mm_mul_pd(p0, p1), _mm_mul_pd(p2, p3)));
+    product *= lanes[0];
+    product *= lanes[1];
+    return i;
+}
+
+template <bool MAXIMUM>
+__attribute__((target("sse2")))
+int extremeSse2(const double* values, int count, double& best) {
+    __m128d b0 = _mm_set1_pd(best), b1 = b0, b2 = b0, b3 = b0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        if (MAXIMUM) {
+            b0 = _mm_max_pd(_mm_loadu_pd(values + i), b0);
+            b1 = _mm_max_pd(_mm_loadu_pd(values + i + 2), b1);
+            b2 = _mm_max_pd(_mm_loadu_pd(values + i + 4), b2);
+            b3 = _mm_max_pd(_mm_loadu_pd(values + i + 6), b3);
+        } else {
+            b0 = _mm_min_pd(_mm_loadu_pd(values + i), b0);
+            b1 = _mm_min_pd(_mm_loadu_pd(values + i + 2), b1);
+            b2 = _mm_min_pd(_mm_loadu_pd(values + i + 4), b2);
+            b3 = _mm_min_pd(_mm_loadu_pd(values + i + 6), b3);
+        }
+    }
+    double lanes[8];
+    _mm_storeu_pd(lanes, b0);
+    _mm_storeu_pd(lanes + 2, b1);
+    _mm_storeu_pd(lanes + 4, b2);
+    _mm_storeu_pd(lanes + 6, b3);
+    for (int lane = 0; lane < 8; lane++) {
+        if (MAXIMUM ? lanes[lane] > best : lanes[lane] < best) {
+            best = lanes[lane];
+        }
+    }
+    return i;
+}
+
+template <char OP>
+__attribute__((target("sse2")))
+inline __m128d applySse2(__m128d left, __m128d right) {
+    switch (OP) {
+    case '+': return _mm_add_pd(left, right);
+    case '-': return _mm_sub_pd(left, right);
+    case '*': return _mm_mul_pd(left, right);
+    default:  return _mm_div_pd(left, right);
+    }
+}
+
+template <char OP>
+__attribute__((target("sse2")))
+int elementwiseSse2(const double* left, const double* right, double* result, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d r0 = applySse2<OP>(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i));
+        __m128d r1 = applySse2<OP>(_mm_loadu_pd(left + i + 2), _mm_loadu_pd(right + i + 2));
+        _mm_storeu_pd(result + i, r0);
+        _mm_storeu_pd(result + i + 2, r1);
+    }
+    return i;
+}
+
+#endif // KERNELS_X86
+
+template <bool SQUARES>
+int sumVectors(const double* values, int count, double center, double& sum, double& error) {
+#ifdef KERNELS_X86
+    switch (simdLevel()) {
+    case SIMD_AVX:
+        return sumAvx<SQUARES>(values, count, center, sum, error);
+    case SIMD_SSE2:
+        return sumSse2<SQUARES>(values, count, center, sum, error);
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    return 0;
+}
+
+int productVectors(const double* values, int count, double& product) {
+#ifdef KERNELS_X86
+    switch (simdLevel()) {
+    case SIMD_AVX:
+        return productAvx(values, count, product);
+    case SIMD_SSE2:
+        return productSse2(values, count, product);
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    return 0;
+}
+
+template <bool MAXIMUM>
+int extremeVectors(const double* values, int count, double& best) {
+#ifdef KERNELS_X86
+    switch (simdLevel()) {
+    case SIMD_AVX:
+        return extremeAvx<MAXIMUM>(values, count, best);
+    case SIMD_SSE2:
+        return extremeSse2<MAXIMUM>(values, count, best);
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    return 0;
+}
+
+template <char OP>
+int elementwiseVectors(const double* left, const double* right, double* result, int count) {
+#ifdef KERNELS_X86
+    switch (simdLevel()) {
+    case SIMD_AVX:
+        return elementwiseAvx<OP>(left, right, result, count);
+    case SIMD_SSE2:
+        return elementwiseSse2<OP>(left, right, result, count);
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * The compensated sum of the values, or of their squared distances from
+ * the center.  Once an infinity or NaN is reached the compensation itself
+ * turns into NaN, so a non-finite total is recomputed the plain way, which
+ * gives the infinity (or NaN) the values actually add up to.
+ */
+template <bool SQUARES>
+double compensatedSum(const double* values, int count, double center) {
+    double sum = 0.0;
+    double error = 0.0;
+    int i = sumVectors<SQUARES>(values, count, center, sum, error);
+    for (; i < count; i++) {
+        addCompensated(sum, error, term<SQUARES>(values[i], center));
+    }
+    double total = sum - error;
+    if (std::isfinite(total)) {
+        return total;
+    }
+    total = 0.0;
+    for (i = 0; i < count; i++) {
+        total += term<SQUARES>(values[i], center);
+    }
+    return total;
+}
+
+template <char OP>
+void elementwise(const double* left, const double* right, double* result, int count) {
+    int i = elementwiseVectors<OP>(left, right, result, count);
+    for (; i < count; i++) {
+        switch (OP) {
+        case '+': result[i] = left[i] + right[i]; break;
+        case '-': result[i] = left[i] - right[i]; break;
+        case '*': result[i] = left[i] * right[i]; break;
+        default:  result[i] = left[i] / right[i]; break;
+        }
+    }
+}
+
+template <bool MAXIMUM>
+double extreme(const double* values, int count) {
+    double best = values[0];
+    int i = extremeVectors<MAXIMUM>(values, count, best);
+    for (; i < count; i++) {
+        if (MAXIMUM ? values[i] > best : values[i] < best) {
+            best = values[i];
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+double average(const double* values, int count) {
+    return sum(values, count) / count;
+}
+
+double sum(const double* values, int count) {
+    return compensatedSum<false>(values, count, 0.0);
+}
+
+double product(const double* values, int count) {
+    double product = 1.0;
+    int i = productVectors(values, count, product);
+    for (; i < count; i++) {
+        product *= values[i];
+    }
+    return product;
+}
+
+double max(const double* values, int count) {
+    if (count <= 0) {
+        error("max: no values");
+    }
+    return extreme<true>(values, count);
+}
+
+double min(const double* values, int count) {
+    if (count <= 0) {
+        error("min: no values");
+    }
+    return extreme<false>(values, count);
+}
+
+double stdev(const double* values, int count) {
+    // the population standard deviation, from the squared distances to the
+    // mean; subtracting sums of squares would cancel away most of the digits
+    // when the values are large and close together
+    double mean = average(values, count);
+    return sqrt(sumOfSquares(values, count, mean) / count);
+}
+
+double sumOfSquares(const double* values, int count, double center) {
+    return compensatedSum<true>(values, count, center);
+}
+
+void add(const double* left, const double* right, double* result, int count) {
+    elementwise<'+'>(left, right, result, count);
+}
+
+void subtract(const double* left, const double* right, double* result, int count) {
+    elementwise<'-'>(left, right, result, count);
+}
+
+void multiply(const double* left, const double* right, double* result, int count) {
+    elementwise<'*'>(left, right, result, count);
+}
+
+void divide(const double* left, const double* right, double* result, int count) {
+    elementwise<'/'>(left, right, result, count);
+}
@@ -0,0 +1,51 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the aggregate kernels behind the built-in range
+ * functions, which work on a plain array of values, and the elementwise
+ * arithmetic used to evaluate a formula over many rows at once.
+ */
+
+#ifndef _kernels_h
+#define _kernels_h
+
+/**
+ * Each function takes a pointer to count contiguous values, which may be
+ * nullptr when count is 0, and returns the same result as the function of
+ * the same name in range.h.  On x86 processors the loops run on AVX or SSE2
+ * vectors, chosen once at runtime from what the processor supports, with
+ * several independent accumulators so that long arrays are limited by
+ * memory bandwidth rather than by the latency of each addition; elsewhere
+ * the same algorithms run on scalars.
+ *
+ * sum, average and stdev use Kahan (compensated) summation, so their
+ * results stay accurate to a few units in the last place however many
+ * values are added; stdev takes two passes, summing the squared distances
+ * from the mean rather than subtracting two large sums of squares.
+ * min and max throw an error when there are no values.
+ */
+double average(const double* values, int count);
+double sum(const double* values, int count);
+double product(const double* values, int count);
+double max(const double* values, int count);
+double min(const double* values, int count);
+double stdev(const double* values, int count);
+
+/**
+ * Returns the compensated sum of the squared distances of the values from
+ * center, the inner sum of stdev, for callers that need a standard
+ * deviation of values spread over several arrays.
+ */
+double sumOfSquares(const double* values, int count, double center);
+
+/**
+ * Elementwise kernels for evaluating one formula down a run of rows at
+ * once: each stores left[i] op right[i] into result[i] for every i below
+ * count, rounded exactly as the scalar operator would.  result may be the
+ * same array as left or right.
+ */
+void add(const double* left, const double* right, double* result, int count);
+void subtract(const double* left, const double* right, double* result, int count);
+void multiply(const double* left, const double* right, double* result, int count);
+void divide(const double* left, const double* right, double* result, int count);
+
+#endif // _kernels_h
@@ -0,0 +1,117 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the lexer.h interface.
+ */
+
+#include "lexer.h"
+#include <cctype>
+#include "error.h"
+
+namespace {
+
+bool isDigit(const char* p, const char* end) {
+    return p < end && isdigit((unsigned char) *p);
+}
+
+} // namespace
+
+bool Token::is(char ch) const {
+    return length == 1 && *text == ch && type == OPERATOR;
+}
+
+std::string Token::toString() const {
+    return std::string(text, length);
+}
+
+Lexer::Lexer(const std::string& text)
+        : input(text),
+          position(text.data()),
+          end(text.data() + text.length()),
+          hasSaved(false) {
+    // empty
+}
+
+const std::string& Lexer::getInput() const {
+    return input;
+}
+
+bool Lexer::hasMoreTokens() {
+    Token token = nextToken();
+    saveToken(token);
+    return token.type != Token::END;
+}
+
+Token Lexer::nextToken() {
+    if (hasSaved) {
+        hasSaved = false;
+        return saved;
+    }
+    return scan();
+}
+
+void Lexer::saveToken(const Token& token) {
+    if (hasSaved) {
+        error("Lexer::saveToken: a token has already been saved");
+    }
+    saved = token;
+    hasSaved = true;
+}
+
+Token Lexer::scan() {
+    while (position < end && isspace((unsigned char) *position)) {
+        position++;
+    }
+    const char* begin = position;
+    if (position == end) {
+        return makeToken(Token::END, begin);
+    }
+    char ch = *position++;
+    if (isdigit((unsigned char) ch)) {
+        while (isDigit(position, end)) position++;
+        if (position < end && *position == '.') {
+            position++;
+            while (isDigit(position, end)) position++;
+        }
+        if (position < end && (*position == 'e' || *position == 'E')) {
+            // the exponent belongs to the number only if it has digits
+            const char* p = position + 1;
+            if (p < end && (*p == '+' || *p == '-')) p++;
+            if (isDigit(p, end)) {
+                position = p;
+                while (isDigit(position, end)) position++;
+            }
+        }
+        return makeToken(Token::NUMBER, begin);
+    } else if (ch == '"' || ch == '\'') {
+        while (true) {
+            if (position == end) {
+                error("TokenScanner found unterminated string");
+            }
+            char next = *position++;
+            if (next == ch) {
+                break;
+            } else if (next == '\\' && position < end) {
+                position++;
+            }
+        }
+        return makeToken(Token::STRING, begin);
+    } else if (isalnum((unsigned char) ch)) {
+        while (position < end && isalnum((unsigned char) *position)) position++;
+        return makeToken(Token::WORD, begin);
+    } else {
+        return makeToken(Token::OPERATOR, begin);
+    }
+}
+
+Token Lexer::makeToken(Token::Type type, const char* begin) {
+    Token token;
+    token.type = type;
+    token.text = begin;
+    token.length = (int) (position - begin);
+    return token;
+}
+
+std::ostream& operator <<(std::ostream& out, const Lexer& lexer) {
+    const char* rest = lexer.hasSaved ? lexer.saved.text : lexer.position;
+    return out << std::string(rest, lexer.end);
+}
@@ -0,0 +1,97 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the Lexer type, which splits the text of a cell into
+ * the tokens read by the parser.
+ */
+
+#ifndef _lexer_h
+#define _lexer_h
+
+#include <iostream>
+#include <string>
+
+/**
+ * A single token, viewed in place in the text it was scanned from.
+ * A token does not own its characters, so it must not outlive that text.
+ */
+struct Token {
+    /**
+     * The kinds of token, decided by their first character.  A token of
+     * type END has no characters and marks the end of the text.
+     */
+    enum Type {END, NUMBER, WORD, STRING, OPERATOR};
+
+    Type type;
+    const char* text;
+    int length;
+
+    /**
+     * Returns true if this token is the single character ch, such as "(".
+     */
+    bool is(char ch) const;
+
+    /**
+     * Returns a copy of this token's characters.
+     */
+    std::string toString() const;
+};
+
+/**
+ * A scanner that splits text into tokens the same way a TokenScanner set
+ * up with ignoreWhitespace, scanNumbers and scanStrings does, but without
+ * allocating: each token is a pointer into the scanned text.
+ * Whitespace between tokens is skipped, and the rest of the text is read as
+ * - numbers: digits, an optional decimal point followed by more digits, and
+ *   an optional exponent such as "e-3", which is only taken if digits follow;
+ * - words: a letter or digit followed by more letters and digits;
+ * - strings: text in single or double quotes, in which a backslash escapes
+ *   the next character;
+ * - operators: any other single character.
+ */
+class Lexer {
+public:
+    /**
+     * Constructs a lexer over the given text, which must outlive it.
+     */
+    Lexer(const std::string& text);
+
+    /**
+     * Returns the text being scanned.
+     */
+    const std::string& getInput() const;
+
+    /**
+     * Returns true if there are tokens left to read.
+     * Throws an ErrorException if the next token is an unterminated string.
+     */
+    bool hasMoreTokens();
+
+    /**
+     * Reads and returns the next token, or one of type END if the text has
+     * run out.  Throws an ErrorException on an unterminated string.
+     */
+    Token nextToken();
+
+    /**
+     * Pushes the given token back, so that the next call to nextToken()
+     * returns it again.  Only one token can be pushed back at a time.
+     */
+    void saveToken(const Token& token);
+
+    /**
+     * Prints the text not yet scanned, for debugging.
+     */
+    friend std::ostream& operator <<(std::ostream& out, const Lexer& lexer);
+
+private:
+    Token scan();
+    Token makeToken(Token::Type type, const char* begin);
+
+    const std::string& input;
+    const char* position;
+    const char* end;
+    Token saved;
+    bool hasSaved;
+};
+
+#endif // _lexer_h
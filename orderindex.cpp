@@ -0,0 +1,176 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the orderindex.h interface.
+ */
+
+#include "orderindex.h"
+#include <cmath>
+
+OrderIndex::OrderIndex(const Range& range, const Vector<double>& values)
+        : range(range),
+          root(-1),
+          freeList(-1),
+          nanCount(0),
+          seed(2463534242u) {
+    nodes.reserve(values.size());
+    for (double value : values) {
+        if (std::isnan(value)) {
+            nanCount++;
+        } else {
+            root = insert(root, allocate(value));
+        }
+    }
+}
+
+const Range& OrderIndex::getRange() const {
+    return range;
+}
+
+double OrderIndex::percentile(double k) const {
+    if (nanCount > 0) {
+        return NAN;
+    }
+    // the value at rank k * (n - 1), interpolated between its neighbours
+    int n = sizeOf(root);
+    double whole;
+    double frac = std::modf(k * (n - 1), &whole);
+    int lo = (int) whole;
+    double low = kth(lo);
+    if (!(frac > 0.0)) {
+        return low;
+    }
+    return (1 - frac) * low + frac * kth(lo + 1);
+}
+
+void OrderIndex::replace(double oldValue, double newValue) {
+    if (std::isnan(oldValue)) {
+        nanCount--;
+    } else {
+        bool removed = false;
+        root = erase(root, oldValue, removed);
+    }
+    if (std::isnan(newValue)) {
+        nanCount++;
+    } else {
+        root = insert(root, allocate(newValue));
+    }
+}
+
+int OrderIndex::size() const {
+    return sizeOf(root) + nanCount;
+}
+
+int OrderIndex::allocate(double value) {
+    int node;
+    if (freeList >= 0) {
+        node = freeList;
+        freeList = nodes[node].left;
+    } else {
+        node = nodes.size();
+        nodes.push_back(Node());
+    }
+    nodes[node].value = value;
+    nodes[node].priority = nextPriority();
+    nodes[node].size = 1;
+    nodes[node].left = -1;
+    nodes[node].right = -1;
+    return node;
+}
+
+int OrderIndex::erase(int node, double value, bool& removed) {
+    if (node < 0) {
+        return -1;
+    }
+    if (value < nodes[node].value) {
+        nodes[node].left = erase(nodes[node].left, value, removed);
+    } else if (nodes[node].value < value) {
+        nodes[node].right = erase(nodes[node].right, value, removed);
+    } else if (nodes[node].left < 0 || nodes[node].right < 0) {
+        int child = nodes[node].left >= 0 ? nodes[node].left : nodes[node].right;
+        nodes[node].left = freeList;
+        freeList = node;
+        removed = true;
+        return child;
+    } else {
+        // rotate the node down below its higher-priority child and retry
+        if (nodes[nodes[node].left].priority > nodes[nodes[node].right].priority) {
+            node = rotateRight(node);
+            nodes[node].right = erase(nodes[node].right, value, removed);
+        } else {
+            node = rotateLeft(node);
+            nodes[node].left = erase(nodes[node].left, value, removed);
+        }
+    }
+    update(node);
+    return node;
+}
+
+int OrderIndex::insert(int node, int added) {
+    if (node < 0) {
+        return added;
+    }
+    if (nodes[added].value < nodes[node].value) {
+        nodes[node].left = insert(nodes[node].left, added);
+        if (nodes[nodes[node].left].priority > nodes[node].priority) {
+            node = rotateRight(node);
+        }
+    } else {
+        nodes[node].right = insert(nodes[node].right, added);
+        if (nodes[nodes[node].right].priority > nodes[node].priority) {
+            node = rotateLeft(node);
+        }
+    }
+    update(node);
+    return node;
+}
+
+double OrderIndex::kth(int k) const {
+    // the k-th smallest value, 0-based, found by walking down the sizes
+    int node = root;
+    while (node >= 0) {
+        int leftSize = sizeOf(nodes[node].left);
+        if (k < leftSize) {
+            node = nodes[node].left;
+        } else if (k == leftSize) {
+            return nodes[node].value;
+        } else {
+            k -= leftSize + 1;
+            node = nodes[node].right;
+        }
+    }
+    return NAN;
+}
+
+int OrderIndex::rotateLeft(int node) {
+    int pivot = nodes[node].right;
+    nodes[node].right = nodes[pivot].left;
+    nodes[pivot].left = node;
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+int OrderIndex::rotateRight(int node) {
+    int pivot = nodes[node].left;
+    nodes[node].left = nodes[pivot].right;
+    nodes[pivot].right = node;
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+int OrderIndex::sizeOf(int node) const {
+    return node < 0 ? 0 : nodes[node].size;
+}
+
+void OrderIndex::update(int node) {
+    nodes[node].size = 1 + sizeOf(nodes[node].left) + sizeOf(nodes[node].right);
+}
+
+unsigned int OrderIndex::nextPriority() {
+    // xorshift; the priorities only need to look random to the treap
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
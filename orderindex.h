@@ -0,0 +1,79 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the OrderIndex type, which answers MEDIAN, PERCENTILE
+ * and QUARTILE over a range without sorting its values.
+ */
+
+#ifndef _orderindex_h
+#define _orderindex_h
+
+#include <vector>
+#include "range.h"
+#include "vector.h"
+
+/**
+ * The multiset of values in one range, kept sorted in an order-statistics
+ * tree (a treap whose nodes know the size of their subtree), so that the
+ * k-th smallest value takes O(log n) and replacing one value by another
+ * takes O(log n).  NaN values cannot be ordered, so they are only counted;
+ * any NaN in the range makes every percentile NaN.
+ */
+class OrderIndex {
+public:
+    /**
+     * Constructs an index over the given range holding the given values,
+     * one for each of its cells.
+     */
+    OrderIndex(const Range& range, const Vector<double>& values);
+
+    /**
+     * Returns the range this index covers.
+     */
+    const Range& getRange() const;
+
+    /**
+     * Returns the k-th percentile of the values for 0 <= k <= 1, interpolating
+     * between the two nearest values as Excel's PERCENTILE does; k = 0.5
+     * gives the median.
+     */
+    double percentile(double k) const;
+
+    /**
+     * Replaces one occurrence of oldValue by newValue, as when a cell of the
+     * range changes.
+     */
+    void replace(double oldValue, double newValue);
+
+    /**
+     * Returns the number of values in the index.
+     */
+    int size() const;
+
+private:
+    struct Node {
+        double value;
+        unsigned int priority;
+        int size;           // nodes in this subtree
+        int left;
+        int right;
+    };
+
+    Range range;
+    std::vector<Node> nodes;    // -1 stands for no node
+    int root;
+    int freeList;               // unused nodes, linked through left
+    int nanCount;
+    unsigned int seed;
+
+    int allocate(double value);
+    int erase(int node, double value, bool& removed);
+    int insert(int node, int added);
+    double kth(int k) const;
+    int rotateLeft(int node);
+    int rotateRight(int node);
+    int sizeOf(int node) const;
+    void update(int node);
+    unsigned int nextPriority();
+};
+
+#endif // _orderindex_h
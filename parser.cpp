@@ -11,12 +11,14 @@
  */
 
 #include "parser.h"
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include "error.h"
-#include "set.h"
 #include "strlib.h"
-#include "tokenscanner.h"
 #include "expression.h"
 #include "range.h"
 
@@ -28,13 +30,9 @@ static const bool DEBUG = false;
  * ------------------------------
  * This code just reads an expression and then checks for extra tokens.
  */
-Expression* Parser::parseExpression(const std::string& rawText) {
-    TokenScanner scanner;
-    scanner.ignoreWhitespace();
-    scanner.scanNumbers();
-    scanner.scanStrings();
-    scanner.setInput(rawText);
-    Expression* exp = readExpression(scanner);
+Expression* Parser::parseExpression(const std::string& rawText, Arena* arena) {
+    Lexer lexer(rawText);
+    Expression* exp = readExpression(lexer, arena);
     exp->setRawText(rawText);
     return exp;
 }
@@ -45,10 +43,10 @@ Expression* Parser::parseExpression(const std::string& rawText) {
  * This function checks the token against each of the defined operators
  * and returns the appropriate precedence value.
  */
-int Parser::precedence(const std::string& token) {
-    if (token == "+" || token == "-") {
+int Parser::precedence(const Token& token) {
+    if (token.is('+') || token.is('-')) {
         return 1;
-    } else if (token == "*" || token == "/") {
+    } else if (token.is('*') || token.is('/')) {
         return 2;
     } else {
         return 0;
@@ -61,27 +59,35 @@ int Parser::precedence(const std::string& token) {
  * This function scans an overall cell expression.
  * An expression can be a number, a string, or a formula.
  */
-Expression* Parser::readExpression(TokenScanner& scanner) {
-    if (DEBUG) std::cout << "  readExpr(" << scanner << ")" << std::endl;
-    std::string token = scanner.nextToken();
-    TokenType type = scanner.getTokenType(token);
-    if (token == "=") {
+Expression* Parser::readExpression(Lexer& lexer, Arena* arena) {
+    if (DEBUG) std::cout << "  readExpr(" << lexer << ")" << std::endl;
+    Token token = lexer.nextToken();
+    if (token.is('=')) {
         // beginning of a formula
-        Expression* exp = readFormula(scanner);
-        if (scanner.hasMoreTokens()) {
-            error("Parse error: Unexpected token: \"" + scanner.nextToken() + "\"");
+        Expression* exp = readFormula(lexer, arena);
+        if (lexer.hasMoreTokens()) {
+            error("Parse error: Unexpected token: \"" + lexer.nextToken().toString() + "\"");
         }
         return exp;
-    } else if (type == NUMBER && !scanner.hasMoreTokens()) {
-        return new DoubleExp(stringToReal(token));
-    } else {
-        return new TextStringExp(trim(scanner.getInput()));
+    } else if (token.type == Token::NUMBER && !lexer.hasMoreTokens()) {
+        return new (arena) DoubleExp(readNumber(token));
+    }
+    if (token.is('-') && isdigit((unsigned char) token.text[1])) {
+        // so is a negative number, such as "-5"; anything after the number
+        // makes the whole text a string
+        Token number = lexer.nextToken();
+        const std::string& input = lexer.getInput();
+        size_t rest = number.text + number.length - input.data();
+        if (input.find_first_not_of(" \t\n\v\f\r", rest) == std::string::npos) {
+            return new (arena) DoubleExp(-readNumber(number));
+        }
     }
+    return new (arena) TextStringExp(trim(lexer.getInput()));
 }
 
 /**
  * Implementation notes: readFormula
- * Usage: exp = readFormula(scanner, prec);
+ * Usage: exp = readFormula(lexer, arena, prec);
  * ----------------------------------------
  * This implementation uses precedence to resolve the ambiguity in
  * the grammar.  At each level, the parser reads operators and subexpressions
@@ -89,62 +95,102 @@ Expression* Parser::readExpression(TokenScanner& scanner) {
  * one.  When a higher-precedence operator is found, readE calls itself
  * recursively to read that subexpression as a unit.
  */
-Expression* Parser::readFormula(TokenScanner& scanner, int prec) {
-    if (DEBUG) std::cout << "  readForm(" << scanner << "), prec=" << prec << ")" << std::endl;
-    Expression* exp = readTerm(scanner);
-    std::string token;
+Expression* Parser::readFormula(Lexer& lexer, Arena* arena, int prec) {
+    if (DEBUG) std::cout << "  readForm(" << lexer << "), prec=" << prec << ")" << std::endl;
+    Expression* exp = readTerm(lexer, arena);
+    Token token;
     while (true) {
         // read operator
-        token = scanner.nextToken();
+        token = lexer.nextToken();
         int tprec = precedence(token);
         if (tprec <= prec) {
             break;
         }
 
-        if (!scanner.hasMoreTokens()) {
-            error("Parse error: Invalid binary " + token
+        if (!lexer.hasMoreTokens()) {
+            error("Parse error: Invalid binary " + token.toString()
                   + " expression; missing right operand");
             exp = nullptr;
         } else {
-            Expression* rhs = readFormula(scanner, tprec);
-            exp = new CompoundExp(token, exp, rhs);
+            Expression* rhs = readFormula(lexer, arena, tprec);
+            exp = new (arena) CompoundExp(token.toString(), exp, rhs);
         }
     }
-    scanner.saveToken(token);
+    lexer.saveToken(token);
     return exp;
 }
 
+/**
+ * Implementation notes: readNumber
+ * --------------------------------
+ * This function converts a number token with strtod on a copy in a stack
+ * buffer.  A number token has no sign, hex prefix or surrounding spaces, so
+ * strtod reads it exactly as stringToReal would; values too large for a
+ * double go through stringToReal so that they fail the same way.
+ */
+double Parser::readNumber(const Token& token) {
+    char buffer[64];
+    if (token.length >= (int) sizeof(buffer)) {
+        return stringToReal(token.toString());
+    }
+    memcpy(buffer, token.text, token.length);
+    buffer[token.length] = '\0';
+    double value = strtod(buffer, nullptr);
+    if (std::isinf(value)) {
+        return stringToReal(token.toString());
+    }
+    return value;
+}
+
 /**
  * Implementation notes: readRange
- * Usage: exp = readRange(scanner);
+ * Usage: exp = readRange(lexer);
  * --------------------------------
- * This function scans a range of cells, such as A1:A7.
+ * This function scans a range of cells, such as A1:A7.  If argument is not
+ * nullptr, the range must be followed by a comma and a number, such as
+ * A1:A7, 0.9, which is stored into it.
  */
-Range Parser::readRange(TokenScanner& scanner) {
-    if (DEBUG) std::cout << "  readRang(" << scanner << ")" << std::endl;
-    if (scanner.nextToken() != "(") {
+Range Parser::readRange(Lexer& lexer, double* argument) {
+    if (DEBUG) std::cout << "  readRang(" << lexer << ")" << std::endl;
+    if (!lexer.nextToken().is('(')) {
         error("Parse error: Invalid range format; missing initial (.");
     }
-    std::string startCellName = scanner.nextToken();
-    if (!Range::isValidName(startCellName)) {
-        error("Parse error: Invalid start cell name for range: \"" + startCellName + "\"");
+    Token startCellName = lexer.nextToken();
+    CellRef start;
+    if (!CellRef::parse(startCellName.text, startCellName.text + startCellName.length, start)) {
+        error("Parse error: Invalid start cell name for range: \""
+              + startCellName.toString() + "\"");
     }
 
-    std::string sep = scanner.nextToken();
-    if (sep != ":" && sep != "-") {
+    Token sep = lexer.nextToken();
+    if (!sep.is(':') && !sep.is('-')) {
         error("Parse error: Invalid range format; missing : in middle.");
     }
-    std::string endCellName = scanner.nextToken();
-    if (!Range::isValidName(endCellName)) {
-        error("Parse error: Invalid end cell name for range: \"" + endCellName + "\"");
+    Token endCellName = lexer.nextToken();
+    CellRef end;
+    if (!CellRef::parse(endCellName.text, endCellName.text + endCellName.length, end)) {
+        error("Parse error: Invalid end cell name for range: \""
+              + endCellName.toString() + "\"");
+    }
+    if (argument != nullptr) {
+        if (!lexer.nextToken().is(',')) {
+            error("Parse error: Invalid function format; missing , after range.");
+        }
+        Token token = lexer.nextToken();
+        bool negative = token.is('-');
+        if (negative) {
+            token = lexer.nextToken();
+        }
+        if (token.type != Token::NUMBER) {
+            error("Parse error: Invalid function argument: \"" + token.toString() + "\"");
+        }
+        *argument = negative ? -readNumber(token) : readNumber(token);
     }
-    if (scanner.nextToken() != ")") {
+    if (!lexer.nextToken().is(')')) {
         error("Parse error: Invalid range format; missing final ).");
     }
 
-    //Check that is valid values for range
-    Range rng(startCellName, endCellName);
-    return rng;
+    return Range(start, end);
 }
 
 /**
@@ -153,33 +199,45 @@ Range Parser::readRange(TokenScanner& scanner) {
  * This function scans a term, which is either an integer, an identifier,
  * or a parenthesized subexpression.
  */
-Expression* Parser::readTerm(TokenScanner& scanner) {
-    if (DEBUG) std::cout << "readTerm(" << scanner << ")" << std::endl;
-    std::string token = scanner.nextToken();
-    TokenType type = scanner.getTokenType(token);
+Expression* Parser::readTerm(Lexer& lexer, Arena* arena) {
+    if (DEBUG) std::cout << "readTerm(" << lexer << ")" << std::endl;
+    Token token = lexer.nextToken();
     Expression* result = nullptr;
-    if (token == "(") {
+    if (token.is('(')) {
         // beginning of a parenthesized expression
-        Expression* exp = readFormula(scanner);
-        token = scanner.nextToken();
-        if (token != ")") {
+        Expression* exp = readFormula(lexer, arena);
+        if (!lexer.nextToken().is(')')) {
             error("Parse error: Unclosed parenthesis.");
         } else {
             result = exp;
         }
-    } else if (type == NUMBER) {
-        result = new DoubleExp(stringToReal(token));
-    } else if (type == WORD) {
-        token = toUpperCase(token);
-        if (Range::isKnownFunctionName(token)) {
-            result = new RangeExp(token, readRange(scanner));
-        } else if (Range::isValidName(token)) {
-            result = new IdentifierExp(token);
+    } else if (token.type == Token::NUMBER) {
+        result = new (arena) DoubleExp(readNumber(token));
+    } else if (token.type == Token::WORD) {
+        bool takesArgument;
+        const char* function = Range::findFunctionName(token.text, token.length, takesArgument);
+        CellRef ref;
+        if (function != nullptr && takesArgument) {
+            double argument;
+            double whole;
+            Range range = readRange(lexer, &argument);
+            if (strcmp(function, "PERCENTILE") == 0 && !(0 <= argument && argument <= 1)) {
+                error("Parse error: PERCENTILE needs a fraction from 0 to 1");
+            } else if (strcmp(function, "QUARTILE") == 0
+                       && !(0 <= argument && argument <= 4 && !(std::modf(argument, &whole) > 0))) {
+                error("Parse error: QUARTILE needs a quartile from 0 to 4");
+            }
+            result = new (arena) RangeExp(function, range, argument);
+        } else if (function != nullptr) {
+            result = new (arena) RangeExp(function, readRange(lexer));
+        } else if (CellRef::parse(token.text, token.text + token.length, ref)) {
+            result = new (arena) IdentifierExp(toUpperCase(token.toString()));
         } else {
-            error("Parse error: Invalid cell name or token: \"" + token + "\"");
+            error("Parse error: Invalid cell name or token: \""
+                  + toUpperCase(token.toString()) + "\"");
         }
     } else {
-        result = new TextStringExp(token);
+        result = new (arena) TextStringExp(token.toString());
     }
     return result;
 }
@@ -13,9 +13,10 @@
 #ifndef _parser_h
 #define _parser_h
 
+#include "arena.h"
 #include "expression.h"
+#include "lexer.h"
 #include "range.h"
-#include "tokenscanner.h"
 
 class Parser {
 public:
@@ -25,15 +26,18 @@ public:
      * -------------------------------------------
      * Parses a complete expression from the specified text,
      * making sure that there are no tokens left in its scanner at the end.
+     * The nodes are allocated from the given arena, or from the heap if it
+     * is nullptr.
      */
-    static Expression* parseExpression(const std::string& rawText);
+    static Expression* parseExpression(const std::string& rawText, Arena* arena = nullptr);
 
 private:
-    static Expression* readExpression(TokenScanner& scanner);
-    static Expression* readFormula(TokenScanner& scanner, int prec = 0);
-    static Range readRange(TokenScanner& scanner);
-    static Expression* readTerm(TokenScanner& scanner);
-    static int precedence(const std::string& token);
+    static Expression* readExpression(Lexer& lexer, Arena* arena);
+    static Expression* readFormula(Lexer& lexer, Arena* arena, int prec = 0);
+    static double readNumber(const Token& token);
+    static Range readRange(Lexer& lexer, double* argument = nullptr);
+    static Expression* readTerm(Lexer& lexer, Arena* arena);
+    static int precedence(const Token& token);
 };
 
 #endif // _parser_h
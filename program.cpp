@@ -0,0 +1,300 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the program.h interface.
+ */
+
+#include "program.h"
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "error.h"
+#include "kernels.h"
+#include "spreadsheet.h"
+
+const int Program::LOCAL_STACK_SIZE;
+const int Program::BATCH_SIZE;
+
+Program::Program(const Expression* exp) {
+    // size the arrays exactly first, so they can come from the arena
+    int instructions = 0;
+    int rangeCalls = 0;
+    int cellRefs = 0;
+    count(exp, instructions, rangeCalls, cellRefs);
+    code = static_cast<Instruction*>(allocateOwned(instructions * sizeof(Instruction)));
+    ranges = rangeCalls == 0 ? nullptr
+             : static_cast<RangeCall*>(allocateOwned(rangeCalls * sizeof(RangeCall)));
+    bindings = cellRefs == 0 ? nullptr
+               : static_cast<CellRef*>(allocateOwned(cellRefs * sizeof(CellRef)));
+    codeSize = 0;
+    rangeCount = 0;
+    bindingCount = 0;
+    maxDepth = compile(exp);
+}
+
+Program::~Program() {
+    releaseOwned(code, codeSize * sizeof(Instruction));
+    releaseOwned(ranges, rangeCount * sizeof(RangeCall));
+    releaseOwned(bindings, bindingCount * sizeof(CellRef));
+}
+
+double Program::run(Spreadsheet& model, CellNode* const* bindings,
+                    int rowOffset, int columnOffset) const {
+    double local[LOCAL_STACK_SIZE];
+    std::vector<double> deep;
+    double* stack = local;
+    if (maxDepth > LOCAL_STACK_SIZE) {
+        deep.resize(maxDepth);
+        stack = &deep[0];
+    }
+    int top = 0;
+    for (int pc = 0; pc < codeSize; pc++) {
+        const Instruction& instruction = code[pc];
+        switch (instruction.op) {
+        case OP_NUMBER:
+            stack[top++] = instruction.number;
+            break;
+        case OP_CELL: {
+            // a stale cell (lazy mode) is brought up to date first
+            const CellNode* cell = bindings[instruction.binding];
+            stack[top++] = cell->dirty ? model.getCellCalculatedValue(cell->ref)
+                                       : *cell->value;
+            break;
+        }
+        case OP_ADD:
+            top--;
+            stack[top - 1] = stack[top - 1] + stack[top];
+            break;
+        case OP_SUBTRACT:
+            top--;
+            stack[top - 1] = stack[top - 1] - stack[top];
+            break;
+        case OP_MULTIPLY:
+            top--;
+            stack[top - 1] = stack[top - 1] * stack[top];
+            break;
+        case OP_DIVIDE:
+            top--;
+            stack[top - 1] = stack[top - 1] / stack[top];   // divide by 0.0 gives +/- INF
+            break;
+        default: {
+            // a range function, of the range shifted to the cell
+            const RangeCall& call = ranges[instruction.range];
+            stack[top++] = runRange(model, instruction.op,
+                                    shift(call.range, rowOffset, columnOffset),
+                                    call.argument);
+            break;
+        }
+        }
+    }
+    return top > 0 ? stack[top - 1] : 0.0;
+}
+
+void Program::runBatch(Spreadsheet& model, const CellGrid& grid, int count,
+                       int rowOffset, int columnOffset, double* results) const {
+    // the stack holds one column of BATCH_SIZE values per entry
+    std::vector<double> columns(std::max(maxDepth, 1) * BATCH_SIZE);
+    for (int first = 0; first < count; first += BATCH_SIZE) {
+        int rows = std::min(BATCH_SIZE, count - first);
+        int top = 0;
+        for (int pc = 0; pc < codeSize; pc++) {
+            const Instruction& instruction = code[pc];
+            double* column = columns.data() + top * BATCH_SIZE;   // the next free entry
+            switch (instruction.op) {
+            case OP_NUMBER:
+                std::fill(column, column + rows, instruction.number);
+                top++;
+                break;
+            case OP_CELL: {
+                // the cell named by each row, a run down one column
+                const CellRef& ref = bindings[instruction.binding];
+                int row = ref.getRow() + rowOffset + first;
+                int col = ref.getColumn() + columnOffset;
+                Range cells(CellRef(row, col), CellRef(row + rows - 1, col));
+                double* out = column;
+                for (const ValueSpan& span : RangeView(grid, cells)) {
+                    if (span.values == nullptr) {
+                        std::fill(out, out + span.count, 0.0);
+                    } else {
+                        std::copy(span.values, span.values + span.count, out);
+                    }
+                    out += span.count;
+                }
+                top++;
+                break;
+            }
+            case OP_ADD:
+                top--;
+                add(column - 2 * BATCH_SIZE, column - BATCH_SIZE, column - 2 * BATCH_SIZE, rows);
+                break;
+            case OP_SUBTRACT:
+                top--;
+                subtract(column - 2 * BATCH_SIZE, column - BATCH_SIZE, column - 2 * BATCH_SIZE, rows);
+                break;
+            case OP_MULTIPLY:
+                top--;
+                multiply(column - 2 * BATCH_SIZE, column - BATCH_SIZE, column - 2 * BATCH_SIZE, rows);
+                break;
+            case OP_DIVIDE:
+                top--;
+                divide(column - 2 * BATCH_SIZE, column - BATCH_SIZE, column - 2 * BATCH_SIZE, rows);
+                break;
+            default: {
+                const RangeCall& call = ranges[instruction.range];
+                for (int i = 0; i < rows; i++) {
+                    column[i] = runRange(model, instruction.op,
+                                         shift(call.range, rowOffset + first + i, columnOffset),
+                                         call.argument);
+                }
+                top++;
+                break;
+            }
+            }
+        }
+        if (top > 0) {
+            std::copy(columns.begin(), columns.begin() + rows, results + first);
+        } else {
+            std::fill(results + first, results + first + rows, 0.0);
+        }
+    }
+}
+
+int Program::getBindingCount() const {
+    return bindingCount;
+}
+
+const CellRef& Program::getBinding(int i) const {
+    return bindings[i];
+}
+
+int Program::size() const {
+    return codeSize;
+}
+
+void Program::count(const Expression* exp, int& instructions, int& rangeCalls,
+                    int& cellRefs) {
+    instructions++;
+    if (exp->getType() == COMPOUND) {
+        count(exp->getLeft(), instructions, rangeCalls, cellRefs);
+        count(exp->getRight(), instructions, rangeCalls, cellRefs);
+    } else if (exp->getType() == RANGE) {
+        rangeCalls++;
+    } else if (exp->getType() == IDENTIFIER) {
+        cellRefs++;
+    }
+}
+
+/*
+ * Appends the postfix code for the expression and returns the stack depth
+ * it needs.  The functions here mirror the eval methods of expression.cpp.
+ */
+int Program::compile(const Expression* exp) {
+    Instruction instruction;
+    switch (exp->getType()) {
+    case COMPOUND: {
+        int left = compile(exp->getLeft());
+        int right = compile(exp->getRight());
+        std::string op = exp->getOperator();
+        if (op == "+") {
+            instruction.op = OP_ADD;
+        } else if (op == "-") {
+            instruction.op = OP_SUBTRACT;
+        } else if (op == "*") {
+            instruction.op = OP_MULTIPLY;
+        } else if (op == "/") {
+            instruction.op = OP_DIVIDE;
+        } else {
+            error("Illegal operator in expression: " + op);
+        }
+        instruction.number = 0.0;
+        code[codeSize++] = instruction;
+        return std::max(left, right + 1);
+    }
+    case DOUBLE:
+        instruction.op = OP_NUMBER;
+        instruction.number = exp->getValue();
+        code[codeSize++] = instruction;
+        return 1;
+    case IDENTIFIER:
+        instruction.op = OP_CELL;
+        new (&bindings[bindingCount]) CellRef(exp->getCellRef());
+        instruction.binding = bindingCount++;
+        code[codeSize++] = instruction;
+        return 1;
+    case RANGE: {
+        const RangeExp* rangeExp = static_cast<const RangeExp*>(exp);
+        std::string function = rangeExp->getFunction();
+        Range range = rangeExp->getRange();
+        if (function == "AVERAGE" || function == "MEAN") {
+            // every cell of the range counts, whether it was set or not
+            int rows = std::max(0, range.getEndRow() - range.getStartRow() + 1);
+            int cols = std::max(0, range.getEndColumn() - range.getStartColumn() + 1);
+            emitRange(OP_AVERAGE, range, (double) rows * cols);
+        } else if (function == "SUM") {
+            emitRange(OP_SUM, range, 0.0);
+        } else if (function == "PRODUCT") {
+            emitRange(OP_PRODUCT, range, 0.0);
+        } else if (function == "MAX") {
+            emitRange(OP_MAX, range, 0.0);
+        } else if (function == "MIN") {
+            emitRange(OP_MIN, range, 0.0);
+        } else if (function == "MEDIAN") {
+            emitRange(OP_PERCENTILE, range, 0.5);
+        } else if (function == "PERCENTILE") {
+            emitRange(OP_PERCENTILE, range, rangeExp->getArgument());
+        } else if (function == "QUARTILE") {
+            emitRange(OP_PERCENTILE, range, rangeExp->getArgument() / 4);
+        } else if (function == "STDEV") {
+            emitRange(OP_STDEV, range, 0.0);
+        } else {
+            error("Unknown function name: " + function);
+        }
+        return 1;
+    }
+    case TEXTSTRING:
+        // strings have no numeric value
+        instruction.op = OP_NUMBER;
+        instruction.number = 0.0;
+        code[codeSize++] = instruction;
+        return 1;
+    }
+    return 0;
+}
+
+double Program::runRange(Spreadsheet& model, OpCode op, const Range& range, double argument) {
+    switch (op) {
+    case OP_SUM:
+        return model.aggregateFromRange(range, INDEX_SUM);
+    case OP_PRODUCT:
+        return model.aggregateFromRange(range, INDEX_PRODUCT);
+    case OP_MIN:
+        return model.aggregateFromRange(range, INDEX_MIN);
+    case OP_MAX:
+        return model.aggregateFromRange(range, INDEX_MAX);
+    case OP_AVERAGE:
+        return model.aggregateFromRange(range, INDEX_SUM) / argument;
+    case OP_PERCENTILE:
+        return model.percentileFromRange(range, argument);
+    case OP_STDEV:
+        return model.stdevFromRange(range);
+    default:
+        return 0.0;
+    }
+}
+
+Range Program::shift(const Range& range, int rowOffset, int columnOffset) {
+    if (rowOffset == 0 && columnOffset == 0) {
+        return range;
+    }
+    return Range(CellRef(range.getStartRow() + rowOffset, range.getStartColumn() + columnOffset),
+                 CellRef(range.getEndRow() + rowOffset, range.getEndColumn() + columnOffset));
+}
+
+void Program::emitRange(OpCode op, const Range& range, double argument) {
+    RangeCall* call = new (&ranges[rangeCount]) RangeCall();
+    call->range = range;
+    call->argument = argument;
+    Instruction instruction;
+    instruction.op = op;
+    instruction.range = rangeCount++;
+    code[codeSize++] = instruction;
+}
@@ -0,0 +1,139 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the Program type, a formula compiled to a flat list
+ * of instructions that a small stack machine runs.
+ */
+
+#ifndef _program_h
+#define _program_h
+
+#include "arena.h"
+#include "cellgrid.h"
+#include "expression.h"
+#include "range.h"
+
+class Spreadsheet;
+
+/**
+ * A formula lowered from its expression tree to postfix bytecode.  Operators
+ * and range functions become opcodes and each cell reference becomes a slot
+ * in an array of bindings, the nodes of the cells it names, which the caller
+ * passes to run; so running the program involves no virtual calls, string
+ * comparisons or name lookups, and the expression tree is kept alongside
+ * only for getRawText and toString.
+ *
+ * Because the cells are supplied when it runs, one program can serve every
+ * cell sharing a FormulaTemplate: each passes its own bindings and its
+ * offset from the cell the program was compiled for, by which the ranges
+ * are shifted.  run is const and keeps its stack in local storage, so
+ * several threads may run programs at once.  A program created in an arena
+ * keeps its instructions there as well.
+ */
+class Program : public ArenaObject {
+public:
+    /**
+     * Compiles the given expression.
+     */
+    Program(const Expression* exp);
+
+    /**
+     * Frees the instructions.
+     */
+    ~Program();
+
+    /**
+     * Evaluates the formula against the given spreadsheet and returns its
+     * value, the same value the expression's eval would return.  bindings[i]
+     * is the node of the cell getBinding(i) names as seen from the cell being
+     * evaluated, which lies the given number of rows and columns away from
+     * the cell the expression was written for.
+     */
+    double run(Spreadsheet& model, CellNode* const* bindings,
+               int rowOffset, int columnOffset) const;
+
+    /**
+     * Evaluates the formula for count cells down one column at once and
+     * stores their values in results.  The k-th cell lies rowOffset + k rows
+     * and columnOffset columns away from the cell the expression was written
+     * for.  None of the cells may read another, and every cell the formula
+     * reads must be up to date: cell references are copied straight out of
+     * the grid's tiles a column at a time, and the operators run on whole
+     * columns with the kernels of kernels.h, giving the same values run
+     * would.  Range functions are still answered one row at a time.
+     */
+    void runBatch(Spreadsheet& model, const CellGrid& grid, int count,
+                  int rowOffset, int columnOffset, double* results) const;
+
+    /**
+     * Returns the number of cell references in the program.
+     */
+    int getBindingCount() const;
+
+    /**
+     * Returns the i-th cell reference, in the order run expects its bindings.
+     */
+    const CellRef& getBinding(int i) const;
+
+    /**
+     * Returns the number of instructions in the program.
+     */
+    int size() const;
+
+private:
+    enum OpCode {
+        OP_NUMBER,      // push number
+        OP_CELL,        // push the value of bindings[binding]
+        OP_ADD,         // pop two values, push their sum
+        OP_SUBTRACT,
+        OP_MULTIPLY,
+        OP_DIVIDE,
+        OP_SUM,         // push a function of ranges[range]
+        OP_PRODUCT,
+        OP_MIN,
+        OP_MAX,
+        OP_AVERAGE,     // argument is the number of cells
+        OP_PERCENTILE,  // argument is the fraction k
+        OP_STDEV
+    };
+
+    struct Instruction {
+        OpCode op;
+        union {
+            double number;
+            int binding;
+            int range;
+        };
+    };
+
+    struct RangeCall {
+        Range range;
+        double argument;
+    };
+
+    /* Programs needing no more stack than this run without allocating. */
+    static const int LOCAL_STACK_SIZE = 32;
+
+    /* runBatch works through its rows this many at a time. */
+    static const int BATCH_SIZE = 256;
+
+    Instruction* code;
+    int codeSize;
+    RangeCall* ranges;
+    int rangeCount;
+    CellRef* bindings;
+    int bindingCount;
+    int maxDepth;       // the most values on the stack at once
+
+    static void count(const Expression* exp, int& instructions, int& rangeCalls,
+                      int& cellRefs);
+    int compile(const Expression* exp);
+    static double runRange(Spreadsheet& model, OpCode op, const Range& range, double argument);
+    static Range shift(const Range& range, int rowOffset, int columnOffset);
+    void emitRange(OpCode op, const Range& range, double argument);
+
+    // programs are not copyable
+    Program(const Program&);
+    Program& operator =(const Program&);
+};
+
+#endif // _program_h
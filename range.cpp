@@ -12,40 +12,63 @@
 
 #include "range.h"
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <sstream>
+#include <vector>
 #include "error.h"
+#include "kernels.h"
 
 // all functions allowed in a range expression
 const Set<std::string> Range::FUNCTION_NAMES {
+    "AVERAGE", "MAX", "MEAN", "MEDIAN", "MIN", "PERCENTILE", "PRODUCT",
+    "QUARTILE", "STDEV", "SUM"
+};
+
+// functions written as NAME(range, number)
+const Set<std::string> Range::ARGUMENT_FUNCTION_NAMES {
+    "PERCENTILE", "QUARTILE"
+};
+
+// the same names as an array, for lookups that do not build a string;
+// the functions that take an argument come first
+static const char* const FUNCTION_NAME_LIST[] = {
+    "PERCENTILE", "QUARTILE",
     "AVERAGE", "MAX", "MEAN", "MEDIAN", "MIN", "PRODUCT", "STDEV", "SUM"
 };
+static const int ARGUMENT_FUNCTION_COUNT = 2;
 
 Range::Range(int startRow, int startColumn, int endRow, int endColumn) {
-    startCellName = toCellName(startRow, startColumn);
-    endCellName = toCellName(endRow, endColumn);
-    if (!isValidName(startCellName)) {
-        error("Range::constructor: invalid start cell name: " + startCellName);
-    }
-    if (!isValidName(endCellName)) {
-        error("Range::constructor: invalid end cell name: " + endCellName);
+    if (startRow < 0 || startColumn < 0 || endRow < 0 || endColumn < 0) {
+        error("Range::toCellName: row/column cannot be negative");
     }
+    start = CellRef(startRow, startColumn);
+    end = CellRef(endRow, endColumn);
     if (!isValid()) {
         error("Range::constructor: invalid range: " + toString());
     }
 }
 
-Range::Range(const std::string& startCellName, const std::string& endCellName) :
-        startCellName(startCellName),
-        endCellName(endCellName) {
-    if (!isValidName(startCellName)) {
+Range::Range(const std::string& startCellName, const std::string& endCellName) {
+    if (!CellRef::parse(startCellName, start)) {
         error("Range::constructor: invalid start cell name: " + startCellName);
     }
-    if (!isValidName(endCellName)) {
+    if (!CellRef::parse(endCellName, end)) {
         error("Range::constructor: invalid end cell name: " + endCellName);
     }
 }
 
+Range::Range(const CellRef& start, const CellRef& end) :
+        start(start),
+        end(end) {
+    if (!start.isValid()) {
+        error("Range::constructor: invalid start cell");
+    }
+    if (!end.isValid()) {
+        error("Range::constructor: invalid end cell");
+    }
+}
+
 Set<std::string> Range::getAllCellNames() const {
     Set<std::string> cellnames;
     int startRow = getStartRow();
@@ -62,80 +85,86 @@ Set<std::string> Range::getAllCellNames() const {
 }
 
 std::string Range::getEndCellName() const {
-    return endCellName;
+    return end.toString();
+}
+
+CellRef Range::getEnd() const {
+    return end;
 }
 
 int Range::getEndColumn() const {
-    int row, col;
-    toRowColumn(endCellName, row, col);
-    return col;
+    return end.getColumn();
 }
 
 int Range::getEndRow() const {
-    int row, col;
-    toRowColumn(endCellName, row, col);
-    return row;
+    return end.getRow();
 }
 
 std::string Range::getStartCellName() const {
-    return startCellName;
+    return start.toString();
+}
+
+CellRef Range::getStart() const {
+    return start;
 }
 
 int Range::getStartColumn() const {
-    int row, col;
-    toRowColumn(startCellName, row, col);
-    return col;
+    return start.getColumn();
 }
 
 int Range::getStartRow() const {
-    int row, col;
-    toRowColumn(startCellName, row, col);
-    return row;
+    return start.getRow();
 }
 
 bool Range::isKnownFunctionName(const std::string& function) {
     return FUNCTION_NAMES.contains(toUpperCase(function));
 }
 
-bool Range::isValid() const {
-    int startRow, startCol, endRow, endCol;
-    if (!toRowColumn(startCellName, startRow, startCol)
-            || !toRowColumn(endCellName, endRow, endCol)) {
-        return false;
+bool Range::takesArgument(const std::string& function) {
+    return ARGUMENT_FUNCTION_NAMES.contains(toUpperCase(function));
+}
+
+const char* Range::findFunctionName(const char* name, int length, bool& takesArgument) {
+    int count = (int) (sizeof(FUNCTION_NAME_LIST) / sizeof(FUNCTION_NAME_LIST[0]));
+    for (int i = 0; i < count; i++) {
+        const char* function = FUNCTION_NAME_LIST[i];
+        int j = 0;
+        while (j < length && function[j] != '\0'
+               && toupper((unsigned char) name[j]) == function[j]) {
+            j++;
+        }
+        if (j == length && function[j] == '\0') {
+            takesArgument = i < ARGUMENT_FUNCTION_COUNT;
+            return function;
+        }
     }
-    return 0 <= startRow && startRow <= endRow
-        && 0 <= startCol && startCol <= endCol;
+    return nullptr;
+}
+
+bool Range::isValid() const {
+    return start.isValid() && end.isValid()
+        && start.getRow() <= end.getRow()
+        && start.getColumn() <= end.getColumn();
 }
 
 bool Range::isValidName(const std::string& cellname) {
-    int row, col;
-    return toRowColumn(cellname, row, col);
+    CellRef cell;
+    return CellRef::parse(cellname, cell);
 }
 
 std::string Range::toCellName(int row, int column) {
     if (row < 0 || column < 0) {
         error("Range::toCellName: row/column cannot be negative");
     }
-
-    // convert column into a roughly base-26 Excel column name,
-    // e.g. 0 -> "A", 1 -> "B", 26 -> "AA", ...
-    std::string colStr;
-    int col = column + 1;   // 1-based
-    while (col-- > 0) {
-        colStr = charToString((char) ('A' + (col % 26))) + colStr;
-        col /= 26;
-    }
-    std::string rowStr = integerToString(row + 1);
-    return colStr + rowStr;
+    return CellRef(row, column).toString();
 }
 
 bool Range::toRowColumn(const std::string& cellname, int& row, int& column) {
-    int rowTemp = toRow(cellname);
-    int colTemp = toColumn(cellname);
-    if (rowTemp >= 0 && colTemp >= 0) {
+    CellRef cell;
+    if (CellRef::parse(cellname, cell)) {
         // fill in reference parameters
-        row = rowTemp;
-        column = colTemp;
+        row = cell.getRow();
+        column = cell.getColumn();
         return true;
     } else {
         return false;
@@ -143,41 +172,13 @@ bool Range::toRowColumn(const std::string& cellname, int& row, int& column) {
 }
 
 int Range::toColumn(const std::string& cellname) {
-    // chomp out the row at end and keep only the column
-    std::string colStr = trim(toUpperCase(cellname));
-    while (!colStr.empty() && !isalpha(colStr[colStr.length() - 1])) {
-        colStr.erase(colStr.length() - 1, 1);
-    }
-    if (colStr.empty() || !isalpha(colStr[0])) {
-        return -1;
-    }
-
-    // convert alphabetic column letters into a roughly base-26 column index
-    int colNum = 0;
-    for (int i = 0; i < (int) colStr.length(); i++) {
-        char ch = colStr[i];
-        if (!isalpha(ch)) {
-            return -1;
-        } else {
-            colNum = colNum * 26 + (ch - 'A' + 1);
-        }
-    }
-    colNum--;   // convert 1-based to 0-based
-    return colNum;
+    CellRef cell;
+    return CellRef::parse(cellname, cell) ? cell.getColumn() : -1;
 }
 
 int Range::toRow(const std::string& cellname) {
-    // chomp out the column at start and keep only the row
-    std::string rowStr = trim(toUpperCase(cellname));
-    while (!rowStr.empty() && !isdigit(rowStr[0])) {
-        rowStr.erase(0, 1);
-    }
-    if (stringIsInteger(rowStr)) {
-        // convert 1-based to 0-based
-        return stringToInteger(rowStr) - 1;
-    } else {
-        return -1;
-    }
+    CellRef cell;
+    return CellRef::parse(cellname, cell) ? cell.getRow() : -1;
 }
 
 std::string Range::toString() const {
@@ -187,68 +188,71 @@ std::string Range::toString() const {
 }
 
 std::ostream& operator <<(std::ostream& out, const Range& range) {
-    return out << range.getStartCellName() << ":" << range.getEndCellName();
+    return out << range.getStart() << ":" << range.getEnd();
+}
+
+/*
+ * The statistics functions hand the vector's elements to the array kernels
+ * in kernels.cpp.
+ */
+static const double* dataOf(const Vector<double>& values) {
+    return values.isEmpty() ? nullptr : &values[0];
 }
 
 double min(const Vector<double>& values) {
-    double min = values[0];
-    for (int i = 1; i < values.size(); i++) {
-        if (values[i] < min) {
-            min = values[i];
-        }
-    }
-    return min;
+    return min(dataOf(values), values.size());
 }
 
 double max(const Vector<double>& values) {
-    double max = values[0];
-    for (int i = 1; i < values.size(); i++) {
-        if (values[i] > max) {
-            max = values[i];
-        }
-    }
-    return max;
+    return max(dataOf(values), values.size());
 }
 
 double sum(const Vector<double>& values) {
-    double sum = 0;
-    for (double n : values) {
-        sum += n;
-    }
-    return sum;
+    return sum(dataOf(values), values.size());
 }
 
 double product(const Vector<double>& values) {
-    double prod = 1;
-    for (double n : values) {
-        prod *= n;
-    }
-    return prod;
+    return product(dataOf(values), values.size());
 }
 
 /* This function should be accessible by both name "mean" and "average" */
 double average(const Vector<double>& values) {
-    return sum(values) / values.size();
+    return average(dataOf(values), values.size());
 }
 
 double median(const Vector<double>& values) {
-    Vector<double> clone = values;
-    sort(clone.begin(), clone.end());
-    int sz = values.size();
-    if (sz % 2 == 0) {
-        return (clone[sz / 2] + clone[sz / 2 - 1]) / 2;
-    } else {
-        return clone[sz / 2];
-    }
+    return percentile(values, 0.5);
 }
 
-double stdev(const Vector<double>& values) {
-    double sum = 0;
-    double sumsquares = 0;
+/*
+ * Selects the one or two values around rank k * (n - 1) with nth_element
+ * rather than sorting everything, and interpolates between them the way
+ * Excel's PERCENTILE does.
+ */
+double percentile(const Vector<double>& values, double k) {
+    if (values.isEmpty()) {
+        error("percentile: no values");
+    }
+    std::vector<double> clone;
+    clone.reserve(values.size());
     for (double n : values) {
-        sum += n;
-        sumsquares += n * n;
+        if (std::isnan(n)) {
+            return n;
+        }
+        clone.push_back(n);
+    }
+    double whole;
+    double frac = std::modf(k * (clone.size() - 1), &whole);
+    int lo = (int) whole;
+    std::nth_element(clone.begin(), clone.begin() + lo, clone.end());
+    double low = clone[lo];
+    if (!(frac > 0.0)) {
+        return low;
     }
-    int sz = values.size();
-    return sqrt((sz * sumsquares - sum * sum) / (sz * sz));
+    double high = *std::min_element(clone.begin() + lo + 1, clone.end());
+    return (1 - frac) * low + frac * high;
+}
+
+double stdev(const Vector<double>& values) {
+    return stdev(dataOf(values), values.size());
 }
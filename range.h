@@ -14,6 +14,7 @@
 #define _range_h
 
 #include <iostream>
+#include "cellref.h"
 #include "set.h"
 #include "vector.h"
 
@@ -37,6 +38,12 @@ public:
      */
     Range(const std::string& startCellName, const std::string& endCellName);
 
+    /**
+     * Constructs a range enclosing the given start and end cells and all
+     * cells between them.
+     */
+    Range(const CellRef& start, const CellRef& end);
+
     /**
      * Returns a set containing the names of all cells in this range.
      * For example, if the range is B3:C5, returns the set containing
@@ -53,6 +60,11 @@ public:
      */
     std::string getEndCellName() const;
 
+    /**
+     * Returns the ending cell in the range.
+     */
+    CellRef getEnd() const;
+
     /**
      * Returns the 0-based column of the end of this range.
      * For example, if the range is C5:F7, returns 5
@@ -76,6 +88,11 @@ public:
      */
     std::string getStartCellName() const;
 
+    /**
+     * Returns the starting cell in the range.
+     */
+    CellRef getStart() const;
+
     /**
      * Returns the 0-based column of the start of this range.
      * For example, if the range is C5:F7, returns 2
@@ -96,6 +113,20 @@ public:
      */
     static bool isKnownFunctionName(const std::string& function);
 
+    /**
+     * Returns true if the given function takes a number after its range,
+     * as PERCENTILE(A1:A9, 0.9) does.
+     */
+    static bool takesArgument(const std::string& function);
+
+    /**
+     * Looks up the function whose name is the given characters, ignoring
+     * case, without copying them.  Returns the function's name in uppercase
+     * and sets takesArgument as takesArgument() would, or returns nullptr if
+     * there is no function by that name.
+     */
+    static const char* findFunctionName(const char* name, int length, bool& takesArgument);
+
     /**
      * Returns true if the given name is a valid Excel-style name for a cell.
      * For example, "A17" or "BZF45" are valid cell names.
@@ -138,9 +169,12 @@ private:
     // set of all known function names, in uppercase (such as "SUM" and "AVERAGE")
     static const Set<std::string> FUNCTION_NAMES;
 
-    // Excel-style cell names of start/end of this range (e.g. "A5" or "C7")
-    std::string startCellName;
-    std::string endCellName;
+    // the subset of FUNCTION_NAMES that take a number after the range
+    static const Set<std::string> ARGUMENT_FUNCTION_NAMES;
+
+    // start/end cells of this range (e.g. A5 or C7)
+    CellRef start;
+    CellRef end;
 
     /**
      * Returns true if the start row/col come before the end row/col
@@ -161,6 +195,7 @@ double product(const Vector<double>& values);
 double max(const Vector<double>& values);
 double min(const Vector<double>& values);
 double median(const Vector<double>& values);
+double percentile(const Vector<double>& values, double k);
 double stdev(const Vector<double>& values);
 
 #endif // _range_h
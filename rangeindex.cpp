@@ -0,0 +1,244 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the rangeindex.h interface.
+ */
+
+#include "rangeindex.h"
+#include <functional>
+
+template <typename Owner>
+RangeIndex<Owner>::RangeIndex()
+        : root(nullptr),
+          count(0),
+          seed(2463534242u) {
+    /* Empty */
+}
+
+template <typename Owner>
+RangeIndex<Owner>::~RangeIndex() {
+    deleteTree(root);
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::add(const Range& range, Owner* owner) {
+    Node* node = new Node();
+    node->startRow = range.getStartRow();
+    node->endRow = range.getEndRow();
+    node->startCol = range.getStartColumn();
+    node->endCol = range.getEndColumn();
+    node->owner = owner;
+    node->priority = nextPriority();
+    node->maxEndRow = node->endRow;
+    node->left = nullptr;
+    node->right = nullptr;
+    root = insert(root, node);
+    count++;
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::clear() {
+    deleteTree(root);
+    root = nullptr;
+    count = 0;
+}
+
+template <typename Owner>
+bool RangeIndex<Owner>::contains(const Range& range) const {
+    // pairs with the same bounds are adjacent in the order, so an ordinary
+    // search that ignores the owner finds one if there is any
+    Node key;
+    key.startRow = range.getStartRow();
+    key.endRow = range.getEndRow();
+    key.startCol = range.getStartColumn();
+    key.endCol = range.getEndColumn();
+    const Node* node = root;
+    while (node != nullptr) {
+        int cmp = compareBounds(&key, node);
+        if (cmp == 0) return true;
+        node = cmp < 0 ? node->left : node->right;
+    }
+    return false;
+}
+
+template <typename Owner>
+bool RangeIndex<Owner>::covers(int row, int column) const {
+    return stab(root, row, column, nullptr);
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::findOwners(int row, int column, Vector<Owner*>& owners) const {
+    stab(root, row, column, &owners);
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::remove(const Range& range, Owner* owner) {
+    Node key;
+    key.startRow = range.getStartRow();
+    key.endRow = range.getEndRow();
+    key.startCol = range.getStartColumn();
+    key.endCol = range.getEndColumn();
+    key.owner = owner;
+    bool removed = false;
+    root = erase(root, key, removed);
+    if (removed) {
+        count--;
+    }
+}
+
+template <typename Owner>
+int RangeIndex<Owner>::size() const {
+    return count;
+}
+
+/*
+ * Orders nodes by start row first, which is what the stabbing query relies
+ * on; the remaining fields only make the order total so that remove()
+ * can find an exact pair.
+ */
+template <typename Owner>
+int RangeIndex<Owner>::compare(const Node* a, const Node* b) {
+    int cmp = compareBounds(a, b);
+    if (cmp != 0) return cmp;
+    if (a->owner != b->owner) return std::less<Owner*>()(a->owner, b->owner) ? -1 : 1;
+    return 0;
+}
+
+template <typename Owner>
+int RangeIndex<Owner>::compareBounds(const Node* a, const Node* b) {
+    if (a->startRow != b->startRow) return a->startRow < b->startRow ? -1 : 1;
+    if (a->endRow != b->endRow) return a->endRow < b->endRow ? -1 : 1;
+    if (a->startCol != b->startCol) return a->startCol < b->startCol ? -1 : 1;
+    if (a->endCol != b->endCol) return a->endCol < b->endCol ? -1 : 1;
+    return 0;
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::deleteTree(Node* node) {
+    if (node != nullptr) {
+        deleteTree(node->left);
+        deleteTree(node->right);
+        delete node;
+    }
+}
+
+template <typename Owner>
+typename RangeIndex<Owner>::Node* RangeIndex<Owner>::erase(Node* node, const Node& key,
+                                                         bool& removed) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+    int cmp = compare(&key, node);
+    if (cmp < 0) {
+        node->left = erase(node->left, key, removed);
+    } else if (cmp > 0) {
+        node->right = erase(node->right, key, removed);
+    } else if (node->left == nullptr || node->right == nullptr) {
+        Node* child = node->left != nullptr ? node->left : node->right;
+        delete node;
+        removed = true;
+        return child;
+    } else {
+        // rotate the node down below its higher-priority child and retry
+        if (node->left->priority > node->right->priority) {
+            node = rotateRight(node);
+            node->right = erase(node->right, key, removed);
+        } else {
+            node = rotateLeft(node);
+            node->left = erase(node->left, key, removed);
+        }
+    }
+    update(node);
+    return node;
+}
+
+template <typename Owner>
+typename RangeIndex<Owner>::Node* RangeIndex<Owner>::insert(Node* node, Node* added) {
+    if (node == nullptr) {
+        return added;
+    }
+    if (compare(added, node) < 0) {
+        node->left = insert(node->left, added);
+        if (node->left->priority > node->priority) {
+            node = rotateRight(node);
+        }
+    } else {
+        node->right = insert(node->right, added);
+        if (node->right->priority > node->priority) {
+            node = rotateLeft(node);
+        }
+    }
+    update(node);
+    return node;
+}
+
+template <typename Owner>
+typename RangeIndex<Owner>::Node* RangeIndex<Owner>::rotateLeft(Node* node) {
+    Node* pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+template <typename Owner>
+typename RangeIndex<Owner>::Node* RangeIndex<Owner>::rotateRight(Node* node) {
+    Node* pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+template <typename Owner>
+void RangeIndex<Owner>::update(Node* node) {
+    node->maxEndRow = node->endRow;
+    if (node->left != nullptr && node->left->maxEndRow > node->maxEndRow) {
+        node->maxEndRow = node->left->maxEndRow;
+    }
+    if (node->right != nullptr && node->right->maxEndRow > node->maxEndRow) {
+        node->maxEndRow = node->right->maxEndRow;
+    }
+}
+
+/*
+ * Standard interval tree search: a subtree whose largest end row is above
+ * the row cannot contain a match, and nothing to the right of a node
+ * starting below the row can either.  With owners == nullptr the search
+ * stops at the first match.
+ */
+template <typename Owner>
+bool RangeIndex<Owner>::stab(const Node* node, int row, int column,
+                             Vector<Owner*>* owners) {
+    bool found = false;
+    while (node != nullptr && node->maxEndRow >= row) {
+        if (stab(node->left, row, column, owners)) {
+            found = true;
+            if (owners == nullptr) return true;
+        }
+        if (node->startRow > row) {
+            break;
+        }
+        if (row <= node->endRow && node->startCol <= column && column <= node->endCol) {
+            found = true;
+            if (owners == nullptr) return true;
+            owners->add(node->owner);
+        }
+        node = node->right;
+    }
+    return found;
+}
+
+template <typename Owner>
+unsigned int RangeIndex<Owner>::nextPriority() {
+    // xorshift; the priorities only need to look random to the treap
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// the owners the engine keeps ranges for
+template class RangeIndex<CellNode>;
+template class RangeIndex<OrderIndex>;
@@ -0,0 +1,111 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the RangeIndex type, which remembers which cells
+ * read which ranges so that the dependents of a cell can be found without
+ * storing one graph edge per cell covered by a range.  The same index finds
+ * the order indexes that a changed cell falls in.
+ */
+
+#ifndef _rangeindex_h
+#define _rangeindex_h
+
+#include "range.h"
+#include "vector.h"
+
+struct CellNode;
+class OrderIndex;
+
+/**
+ * A set of (range, owner) pairs, where the owner is the node of the cell
+ * whose formula reads the range, or the order index kept for the range.
+ * The ranges are kept in an interval tree on their rows (a treap augmented
+ * with the largest end row of each subtree), so memory is proportional to
+ * the number of ranges rather than the number of cells they cover, and
+ * finding every range that contains a given cell takes O(log n + k) for k
+ * ranges overlapping that row.
+ */
+template <typename Owner>
+class RangeIndex {
+public:
+    /**
+     * Constructs an empty index.
+     */
+    RangeIndex();
+
+    /**
+     * Frees the memory used by the index.
+     */
+    ~RangeIndex();
+
+    /**
+     * Records that the given owner cell reads the given range.
+     * The same pair may be added more than once; each add needs its own remove.
+     */
+    void add(const Range& range, Owner* owner);
+
+    /**
+     * Removes every pair from the index.
+     */
+    void clear();
+
+    /**
+     * Returns true if any owner reads exactly the given range.
+     */
+    bool contains(const Range& range) const;
+
+    /**
+     * Returns true if any range in the index contains the given 0-based cell.
+     */
+    bool covers(int row, int column) const;
+
+    /**
+     * Appends to owners the owner of every range that contains the given
+     * 0-based cell.  An owner appears once per such range.
+     */
+    void findOwners(int row, int column, Vector<Owner*>& owners) const;
+
+    /**
+     * Removes one occurrence of the given pair, if present.
+     */
+    void remove(const Range& range, Owner* owner);
+
+    /**
+     * Returns the number of pairs in the index.
+     */
+    int size() const;
+
+private:
+    struct Node {
+        int startRow;
+        int endRow;
+        int startCol;
+        int endCol;
+        Owner* owner;
+        unsigned int priority;
+        int maxEndRow;      // largest endRow in this subtree
+        Node* left;
+        Node* right;
+    };
+
+    Node* root;
+    int count;
+    unsigned int seed;
+
+    static int compare(const Node* a, const Node* b);
+    static int compareBounds(const Node* a, const Node* b);
+    static void deleteTree(Node* node);
+    static Node* erase(Node* node, const Node& key, bool& removed);
+    static Node* insert(Node* node, Node* added);
+    static Node* rotateLeft(Node* node);
+    static Node* rotateRight(Node* node);
+    static void update(Node* node);
+    static bool stab(const Node* node, int row, int column,
+                     Vector<Owner*>* owners);
+    unsigned int nextPriority();
+
+    // indexes are not copyable
+    RangeIndex(const RangeIndex&);
+    RangeIndex& operator =(const RangeIndex&);
+};
+
+#endif // _rangeindex_h
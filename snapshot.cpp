@@ -0,0 +1,81 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the MappedFile type of snapshot.h.
+ */
+
+#include "snapshot.h"
+#include <fstream>
+#include "error.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+        : data(nullptr),
+          size(0) {
+    // read the whole file, since there is no mmap
+    std::ifstream infile(filename.c_str(), std::ios_base::binary | std::ios_base::in);
+    if (infile.fail()) {
+        error("MappedFile: cannot open " + filename);
+    }
+    infile.seekg(0, std::ios_base::end);
+    buffer.resize((size_t) infile.tellg());
+    infile.seekg(0, std::ios_base::beg);
+    infile.read(buffer.data(), buffer.size());
+    if (infile.fail()) {
+        error("MappedFile: cannot read " + filename);
+    }
+    data = buffer.data();
+    size = buffer.size();
+}
+
+MappedFile::~MappedFile() {
+    // the buffer frees itself
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& filename)
+        : data(nullptr),
+          size(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error("MappedFile: cannot open " + filename);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        error("MappedFile: cannot read " + filename);
+    }
+    size = (size_t) info.st_size;
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            error("MappedFile: cannot map " + filename);
+        }
+        data = static_cast<const char*>(mapped);
+    }
+    // the mapping stays valid after the file is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+#endif // _WIN32
+
+const char* MappedFile::getData() const {
+    return data;
+}
+
+size_t MappedFile::getSize() const {
+    return size;
+}
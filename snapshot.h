@@ -0,0 +1,128 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the layout of the binary snapshot format written by
+ * Spreadsheet::saveSnapshot, and the MappedFile type used to read it.
+ */
+
+#ifndef _snapshot_h
+#define _snapshot_h
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * A snapshot is the whole state of a sheet as flat arrays of fixed-size
+ * records, so that it can be read straight out of a memory-mapped file.
+ * It starts with a SnapshotHeader, whose section table gives the offset
+ * and record count of each section below; sections start on 8-byte
+ * boundaries.  Numbers are in the byte order of the machine that wrote the
+ * file, which the header records so that a foreign file is rejected.
+ * Version 2 added SNAPSHOT_STORED; version 1 files are still read.
+ */
+static const char SNAPSHOT_MAGIC[8] = {'S', '1', '2', '3', 'S', 'N', 'A', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+enum SnapshotSectionId {
+    SNAPSHOT_TEMPLATES,     // SnapshotTemplate records
+    SNAPSHOT_CELLS,         // SnapshotCell records, sorted by cell
+    SNAPSHOT_PRECEDENTS,    // uint32_t indexes into the cells
+    SNAPSHOT_RANGES,        // SnapshotRange records
+    SNAPSHOT_TEXT,          // characters of the template texts
+    SNAPSHOT_SECTION_COUNT
+};
+
+struct SnapshotSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+};
+
+/**
+ * A formula template, stored as its raw text in its origin cell.  Unlike
+ * the other sections this is not read in place: a template keeps its
+ * expression tree as well as its program, for raw text and for linking
+ * cells, so opening a snapshot parses and compiles each template once.
+ * That is about 3 microseconds a template, most of the time to open a
+ * sheet whose every formula differs, and little when cells share them.
+ */
+struct SnapshotTemplate {
+    int32_t originRow;
+    int32_t originColumn;
+    uint64_t textOffset;
+    uint64_t textLength;
+};
+
+/**
+ * A cell with its computed value and its place in the dependency graph.
+ * Its precedents and ranges are runs of the precedent and range sections.
+ */
+struct SnapshotCell {
+    int32_t row;
+    int32_t column;
+    double value;
+    int32_t order;
+    int32_t formula;            // index of its template, -1 if only referenced
+    uint32_t firstPrecedent;
+    uint32_t precedentCount;
+    uint32_t firstRange;
+    uint32_t rangeCount;
+    uint32_t flags;             // SNAPSHOT_DIRTY and SNAPSHOT_STORED bits
+    uint32_t reserved;
+};
+
+static const uint32_t SNAPSHOT_DIRTY = 1;      // the value is out of date
+static const uint32_t SNAPSHOT_STORED = 2;     // an imported value, with no formula
+
+struct SnapshotRange {
+    int32_t startRow;
+    int32_t startColumn;
+    int32_t endRow;
+    int32_t endColumn;
+};
+
+/**
+ * A read-only view of a whole file.  The file is memory-mapped where the
+ * platform supports it, and read into memory otherwise.
+ */
+class MappedFile {
+public:
+    /**
+     * Maps the given file.  Throws an ErrorException if it cannot be read.
+     */
+    MappedFile(const std::string& filename);
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedFile();
+
+    /**
+     * Returns the contents of the file.
+     */
+    const char* getData() const;
+
+    /**
+     * Returns the length of the file in bytes.
+     */
+    size_t getSize() const;
+
+private:
+    const char* data;
+    size_t size;
+    std::vector<char> buffer;   // the contents, when not mapped
+
+    // mapped files are not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator =(const MappedFile&);
+};
+
+#endif // _snapshot_h
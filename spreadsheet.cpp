@@ -1,8 +1,97 @@
 
 #include "spreadsheet.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 #include "view.h"
 #include "parser.h"
+#include "program.h"
 #include "error.h"
+#include "archive.h"
+#include "csv.h"
+#include "kernels.h"
+#include "snapshot.h"
+#include "set.h"
+#include "stack.h"
+#include "map.h"
+
+// levels smaller than this are evaluated on the calling thread
+static const int MIN_PARALLEL_LEVEL_SIZE = 64;
+
+// runs of at least this many cells sharing a formula down a column are
+// evaluated together
+static const int MIN_BATCH_RUN = 8;
+
+// longer runs are cut into pieces this long, to be shared out among threads
+static const int MAX_BATCH_RUN = 1024;
+
+// .123 files shorter than this are read and parsed on the calling thread
+static const size_t MIN_PARALLEL_LOAD_SIZE = 64 * 1024;
+
+// a larger file is cut into this many chunks per thread, so that threads
+// finishing early can take over the work of the others
+static const int LOAD_TASKS_PER_THREAD = 4;
+
+// CSV output is written to the stream in blocks of about this many characters
+static const size_t CSV_BLOCK_SIZE = 64 * 1024;
+
+// a journal longer than this is compacted into a fresh snapshot
+static const size_t MAX_JOURNAL_SIZE = 16 * 1024 * 1024;
+
+// templates no cell uses any more are kept, so that their text is not
+// parsed again if it comes back, until there are more than this many
+static const int MAX_UNUSED_TEMPLATES = 4096;
+
+// aggregates over fewer rows than this just scan the values
+static const int MIN_INDEXED_RANGE_HEIGHT = 64;
+
+// percentiles of ranges with fewer cells than this select from a copy
+static const int MIN_ORDER_INDEXED_SIZE = 64;
+
+// applies the given function to the values of the range, one span at a
+// time with the kernels of kernels.h; missing cells count as 0
+static double aggregate(IndexedFunction function, const RangeView& view) {
+    bool first = true;
+    double result = 0.0;
+    for (const ValueSpan& span : view) {
+        double partial = 0.0;
+        if (span.values != nullptr) {
+            switch (function) {
+            case INDEX_SUM:
+                partial = sum(span.values, span.count);
+                break;
+            case INDEX_MIN:
+                partial = min(span.values, span.count);
+                break;
+            case INDEX_MAX:
+                partial = max(span.values, span.count);
+                break;
+            case INDEX_PRODUCT:
+                partial = product(span.values, span.count);
+                break;
+            }
+        }
+        result = first ? partial : ColumnIndex::combine(function, result, partial);
+        first = false;
+    }
+    if (first) {
+        // an empty range, which has no minimum or maximum
+        if (function == INDEX_MIN || function == INDEX_MAX) {
+            error("no values in range");
+        }
+        return function == INDEX_PRODUCT ? 1.0 : 0.0;
+    }
+    return result;
+}
 
 using namespace std;
 
@@ -13,252 +102,2078 @@ Spreadsheet::Spreadsheet(View* view) {
         error("view is a nullptr");
     }
     this->view = view;
+    lastRecalcCount = 0;
+    lazy = false;
+    dirtyCount = 0;
+    pool = nullptr;
+    batching = false;
+    lowestOrder = 0;
+    highestOrder = 0;
+    inParallelLevel = false;
+    unusedTemplateCount = 0;
+    parseCacheHits = 0;
+    parseCacheMisses = 0;
+    journal = nullptr;
 }
 
 Spreadsheet::~Spreadsheet() {
-    // destructor
+    // destructor; the journal is closed first so that it keeps the cells
+    closeJournal();
     clear();
+    for (Arena* parseArena : parseArenas) {
+        delete parseArena;
+    }
+    delete pool;
+}
+
+void Spreadsheet::beginBatch() {
+    // queue setCell calls until commit()
+    if (batching) {
+        error("a batch is already in progress");
+    }
+    batching = true;
 }
 
 bool Spreadsheet::cellIsFormula(const string& cellname) const {
     // check if the cell is a formula
-    if (cellGraph.containsVertex(cellname)) {
-        if (cellGraph.getVertex(cellname)->data == nullptr) return false;
-        else return cellGraph.getVertex(cellname)->data->isFormula();
-    }
-    return false;
+    CellNode* cell = findCell(cellname);
+    if (cell == nullptr || cell->formula == nullptr) return false;
+    return cell->formula->getExpression()->isFormula();
 }
 
 void Spreadsheet::clear() {
-    // iterate thru the vertex to free the data memory
-    for (VertexV<Expression*>* vertex : cellGraph.getVertexSet()) {
-        delete vertex->data;
+    // journal the clear first, so that one that cannot be journaled leaves
+    // the sheet as it was
+    if (journal != nullptr) {
+        journal->appendClear();
+        journal->commit();
     }
-    // delete the vertex
-    cellGraph.clear();
+    // every template, expression and program lives in the arena, or in the
+    // arenas formulas are parsed into during a load, and holds nothing
+    // outside them, so they are all freed at once without visiting them
+    templates.clear();
+    unusedTemplateCount = 0;
+    parseCacheHits = 0;
+    parseCacheMisses = 0;
+    arena.reset();
+    for (Arena* parseArena : parseArenas) {
+        parseArena->reset();
+    }
+    // delete the cells
+    cells.clear();
+    lowestOrder = 0;
+    highestOrder = 0;
+    rangeIndex.clear();
+    for (HashMap<int, ColumnIndex*>& indexes : columnIndexes) {
+        for (int column : indexes) {
+            delete indexes[column];
+        }
+        indexes.clear();
+    }
+    for (const pair<CellRef, CellRef>& key : orderIndexes) {
+        delete orderIndexes[key];
+    }
+    orderIndexes.clear();
+    orderIndexRanges.clear();
+    dirtyCount = 0;
+    staleCells.clear();
     view->clearCells();
 }
 
-void Spreadsheet::fillFromRange(const Range& range, Vector<double>& values) {
-    // loop over the range and put all the values in the vector
-    int startRow = range.getStartRow();
-    int startCol = range.getStartColumn();
-    int endRow = range.getEndRow();
-    int endCol = range.getEndColumn();
-    for (int i = startCol; i <= endCol; i++ ) {
-        for (int j = startRow; j <= endRow; j++) {
-            string cellname = Range::toCellName(j, i);
-            // get the value and add to the vector
-            if (cellGraph.getVertex(cellname)->data == nullptr) {
-                    values.add(0);
-            }
-            else values.add(cellGraph.getVertex(cellname)->data->getValue());
+void Spreadsheet::commit() {
+    // apply every queued edit as one transaction
+    if (!batching) {
+        error("no batch is in progress");
+    }
+    Vector<pair<string, string> > edits = pendingEdits;
+    pendingEdits.clear();
+    batching = false;
+    setCells(edits);
+}
 
+double Spreadsheet::stdevFromRange(const Range& range) {
+    // two passes over the grid's own storage, as stdev does over an array;
+    // cells that were never set count as 0
+    refreshRange(range);
+    RangeView view(cells, range);
+    int count = view.size();
+    double total = 0.0;
+    for (const ValueSpan& span : view) {
+        if (span.values != nullptr) {
+            total += sum(span.values, span.count);
+        }
+    }
+    double mean = total / count;
+    double squares = 0.0;
+    for (const ValueSpan& span : view) {
+        if (span.values != nullptr) {
+            squares += sumOfSquares(span.values, span.count, mean);
+        } else {
+            squares += span.count * mean * mean;
         }
     }
+    return sqrt(squares / count);
 }
 
 double Spreadsheet::getCellCalculatedValue(const string& cellname) const {
+    CellRef ref;
+    if (!CellRef::parse(cellname, ref)) return 0.0;
+    return getCellCalculatedValue(ref);
+}
+
+double Spreadsheet::getCellCalculatedValue(const CellRef& ref) const {
     // return the calculated value
-    if (cellGraph.containsVertex(cellname)) {
-        // if nothing in where return 0
-        if (cellGraph.getVertex(cellname)->data == nullptr) return 0.0;
-        else return cellGraph.getVertex(cellname)->data->getValue();
+    CellNode* cell = cells.find(ref);
+    // if nothing in where return 0
+    if (cell == nullptr) return 0.0;
+    if (cell->dirty) {
+        // in lazy mode a stale value is recomputed on demand; this only
+        // fills in the memoized value, so the sheet stays logically const
+        const_cast<Spreadsheet*>(this)->refreshCell(cell);
     }
-    return 0;
+    return *cell->value;
+}
+
+int Spreadsheet::getLastRecalcCount() const {
+    // number of cells evaluated by the most recent recalculation
+    return lastRecalcCount;
+}
+
+int Spreadsheet::getParseCacheHits() const {
+    // number of cell texts that reused a template instead of being parsed
+    return parseCacheHits;
+}
+
+int Spreadsheet::getParseCacheMisses() const {
+    // number of cell texts that had to be parsed
+    return parseCacheMisses;
+}
+
+int Spreadsheet::getThreadCount() const {
+    return pool == nullptr ? 1 : pool->getThreadCount();
+}
+
+bool Spreadsheet::isBatching() const {
+    return batching;
+}
+
+bool Spreadsheet::isLazyEvaluation() const {
+    return lazy;
+}
+
+// the raw text of an imported value: the number itself, which reads back as
+// the same value
+static string storedRawText(double value) {
+    char buffer[MAX_CSV_NUMBER_LENGTH + 1];
+    return string(buffer, formatCsvNumber(value, buffer));
 }
 
 string Spreadsheet::getCellRawText(const string& cellname) const {
     // return the raw text
-    if (cellGraph.containsVertex(cellname)) {
-        if (cellGraph.getVertex(cellname)->data == nullptr) return "";
-        else return cellGraph.getVertex(cellname)->data->getRawText();
+    CellNode* cell = findCell(cellname);
+    if (cell != nullptr && cell->stored) return storedRawText(*cell->value);
+    if (cell == nullptr || cell->formula == nullptr) return "";
+    return cell->formula->getRawText(cell->ref);
+}
+
+// a line of a .123 file, viewed in the text of the file: the cell name and
+// the rest of the line, which is the raw text of the cell
+struct LoadedLine {
+    const char* name;
+    int nameLength;
+    const char* text;
+    int textLength;
+    CellRef ref;
+    bool named;         // whether name is a valid cell name
+    string key;         // the normalized text, if it could be scanned
+    bool normalized;
+};
+
+// cuts [p, end) into lines as reading a name with >> and then the rest of
+// the line with getline would: blank lines are skipped, and a name with
+// nothing at all after it ends the file
+static void readLines(const char* p, const char* end, std::vector<LoadedLine>& lines) {
+    while (true) {
+        while (p < end && isspace((unsigned char) *p)) p++;
+        const char* name = p;
+        while (p < end && !isspace((unsigned char) *p)) p++;
+        if (p == end) break;
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        LoadedLine line;
+        line.name = name;
+        line.nameLength = (int) (p - name);
+        line.text = p;
+        line.textLength = (int) ((newline == nullptr ? end : newline) - p);
+        line.named = false;
+        line.normalized = false;
+        lines.push_back(line);
+        p = newline == nullptr ? end : newline + 1;
     }
-    return "";
 }
 
 void Spreadsheet::load(istream& infile) {
 
     // clear the old memory
     clear();
-    // read in the file
-    while (!infile.fail()) {
-        string cellname, rawText;
-        infile >> cellname;
-        getline(infile, rawText);
-        if (infile.fail()) break;
-        setCell(cellname, rawText);
+    // read in the whole file, then build the sheet from it in one pass
+    string text((istreambuf_iterator<char>(infile)), istreambuf_iterator<char>());
+    loadCells(text);
+    if (journal != nullptr) {
+        compactJournal();
+    }
+}
+
+void Spreadsheet::loadCells(const string& text) {
+    // fill the empty sheet from the text of a .123 file: parse every cell,
+    // link them all, order the whole graph once, evaluate it once and only
+    // then display it; on any error the sheet is left empty.  A later line
+    // for a cell replaces an earlier one.
+    //
+    // Reading the lines and parsing their formulas can be done by the
+    // thread pool: the text is cut into chunks on line boundaries, each
+    // read into its own list of lines, and the formulas are parsed into one
+    // arena per task.  Everything is merged in file order, so the result and
+    // any error are the same as when reading serially.
+    int chunkCount = 1;
+    if (pool != nullptr && text.length() >= MIN_PARALLEL_LOAD_SIZE) {
+        chunkCount = pool->getThreadCount() * LOAD_TASKS_PER_THREAD;
+    }
+    auto runTasks = [this, chunkCount](const std::function<void(int)>& task) {
+        if (chunkCount == 1) {
+            task(0);
+        } else {
+            pool->run(chunkCount, task);
+        }
+    };
+
+    // each chunk starts just after a newline, so no line is split
+    Vector<size_t> starts;
+    starts.add(0);
+    for (int i = 1; i < chunkCount; i++) {
+        size_t start = text.find('\n', max(starts[i - 1], text.length() / chunkCount * i));
+        starts.add(start == string::npos ? text.length() : start + 1);
+    }
+    starts.add(text.length());
+    std::vector<std::vector<LoadedLine> > chunks(chunkCount);
+    runTasks([&text, &starts, &chunks](int chunk) {
+        readLines(text.data() + starts[chunk], text.data() + starts[chunk + 1], chunks[chunk]);
+        for (LoadedLine& line : chunks[chunk]) {
+            line.named = CellRef::parse(line.name, line.name + line.nameLength, line.ref);
+            if (line.named) {
+                try {
+                    line.key = FormulaTemplate::normalize(
+                            string(line.text, line.textLength), line.ref);
+                    line.normalized = true;
+                } catch (ErrorException&) {
+                    // left for the parser to report
+                }
+            }
+        }
+    });
+
+    // the last line for each cell, in the order the cells first appear
+    std::vector<const LoadedLine*> lines;
+    std::unordered_map<uint64_t, int> indexes;
+    for (const std::vector<LoadedLine>& chunk : chunks) {
+        for (const LoadedLine& line : chunk) {
+            if (!line.named) {
+                error("invalid cell name: " + string(line.name, line.nameLength));
+            }
+            auto found = indexes.find(line.ref.getKey());
+            if (found == indexes.end()) {
+                indexes[line.ref.getKey()] = lines.size();
+                lines.push_back(&line);
+            } else {
+                lines[found->second] = &line;
+            }
+        }
+    }
+
+    try {
+        // only the first cell with each normalized text is parsed
+        std::vector<int> jobs;              // indexes of the lines to parse
+        std::vector<int> jobOf(lines.size());
+        HashMap<string, int> jobsByKey;
+        for (int i = 0; i < (int) lines.size(); i++) {
+            if (lines[i]->normalized && jobsByKey.containsKey(lines[i]->key)) {
+                jobOf[i] = jobsByKey[lines[i]->key];
+            } else {
+                jobOf[i] = jobs.size();
+                if (lines[i]->normalized) {
+                    jobsByKey.put(lines[i]->key, jobs.size());
+                }
+                jobs.push_back(i);
+            }
+        }
+        while (parseArenas.size() < chunkCount) {
+            parseArenas.add(new Arena());
+        }
+        std::vector<Expression*> exps(jobs.size(), nullptr);
+        runTasks([this, chunkCount, &jobs, &lines, &exps](int task) {
+            Arena* taskArena = chunkCount == 1 ? &arena : parseArenas[task];
+            size_t end = jobs.size() * (task + 1) / chunkCount;
+            for (size_t job = jobs.size() * task / chunkCount; job < end; job++) {
+                const LoadedLine* line = lines[jobs[job]];
+                try {
+                    exps[job] = Parser::parseExpression(
+                            string(line->text, line->textLength), taskArena);
+                } catch (exception&) {
+                    // reported below, in file order
+                }
+            }
+        });
+        Vector<FormulaTemplate*> formulas;
+        for (size_t job = 0; job < jobs.size(); job++) {
+            const LoadedLine* line = lines[jobs[job]];
+            if (exps[job] == nullptr) {
+                error("invalid input:" + string(line->text, line->textLength));
+            }
+            formulas.add(new (&arena) FormulaTemplate(exps[job], line->ref, line->key));
+            templates.put(line->key, formulas[job]);
+            parseCacheMisses++;
+        }
+
+        Vector<CellNode*> edited;
+        for (int i = 0; i < (int) lines.size(); i++) {
+            CellNode* cell = addCell(lines[i]->ref, false);
+            cell->formula = formulas[jobOf[i]];
+            if (jobs[jobOf[i]] != i) {
+                cell->formula->addUser();
+                parseCacheHits++;
+            }
+            edited.add(cell);
+        }
+        linkCells(edited);
+    } catch (ErrorException&) {
+        clear();
+        throw;
+    }
+}
+
+void Spreadsheet::linkCells(const Vector<CellNode*>& edited) {
+    // link the new cells of an empty sheet: add all of their edges, order
+    // the whole graph once, then evaluate it once and display the cells
+    for (CellNode* cell : edited) {
+        if (cell->formula != nullptr) {
+            addEdges(cell->formula, cell->formula->getExpression(), cell);
+        }
+    }
+
+    Vector<CellNode*> order;
+    Vector<CellNode*> cycle;
+    if (!sortTopologically(edited, order, cycle)) {
+        string path = cycle[0]->ref.toString();
+        for (int i = 1; i < cycle.size(); i++) {
+            path += " -> " + cycle[i]->ref.toString();
+        }
+        error("circular reference: " + path);
+    }
+    for (CellNode* cell : edited) {
+        if (cell->formula != nullptr) {
+            bindCell(cell);
+        }
+    }
+
+    if (pool != nullptr && order.size() >= MIN_PARALLEL_LEVEL_SIZE) {
+        evaluateInParallel(order);
+    } else {
+        for (CellNode* cell : order) {
+            evaluate(cell);
+        }
+    }
+    lastRecalcCount = order.size();
+    for (CellNode* cell : edited) {
+        display(cell);
+    }
+}
+
+// returns the records of the given section of a snapshot, checking that
+// they lie inside the file
+static const void* snapshotSection(const MappedFile& file, SnapshotSectionId id,
+                                   size_t recordSize) {
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(file.getData());
+    const SnapshotSection& section = header->sections[id];
+    if (section.offset % 8 != 0 || section.offset > file.getSize()
+            || section.count > (file.getSize() - section.offset) / recordSize) {
+        error("Spreadsheet::loadSnapshot: section out of bounds");
+    }
+    return file.getData() + section.offset;
+}
+
+void Spreadsheet::loadSnapshot(const string& filename) {
+    // map the file and check it all before replacing the sheet with it
+    MappedFile file(filename);
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(file.getData());
+    if (file.getSize() < sizeof(SnapshotHeader)
+            || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        error("Spreadsheet::loadSnapshot: not a snapshot: " + filename);
+    }
+    if (header->version < 1 || header->version > SNAPSHOT_VERSION
+            || header->byteOrder != SNAPSHOT_BYTE_ORDER) {
+        error("Spreadsheet::loadSnapshot: unsupported snapshot version or byte order");
+    }
+    const SnapshotTemplate* templateRecords = static_cast<const SnapshotTemplate*>(
+            snapshotSection(file, SNAPSHOT_TEMPLATES, sizeof(SnapshotTemplate)));
+    const SnapshotCell* cellRecords = static_cast<const SnapshotCell*>(
+            snapshotSection(file, SNAPSHOT_CELLS, sizeof(SnapshotCell)));
+    const uint32_t* precedents = static_cast<const uint32_t*>(
+            snapshotSection(file, SNAPSHOT_PRECEDENTS, sizeof(uint32_t)));
+    const SnapshotRange* ranges = static_cast<const SnapshotRange*>(
+            snapshotSection(file, SNAPSHOT_RANGES, sizeof(SnapshotRange)));
+    const char* text = static_cast<const char*>(snapshotSection(file, SNAPSHOT_TEXT, 1));
+    uint64_t templateCount = header->sections[SNAPSHOT_TEMPLATES].count;
+    uint64_t cellCount = header->sections[SNAPSHOT_CELLS].count;
+    uint64_t precedentCount = header->sections[SNAPSHOT_PRECEDENTS].count;
+    uint64_t rangeCount = header->sections[SNAPSHOT_RANGES].count;
+    uint64_t textLength = header->sections[SNAPSHOT_TEXT].count;
+    for (uint64_t i = 0; i < templateCount; i++) {
+        const SnapshotTemplate& record = templateRecords[i];
+        if (record.originRow < 0 || record.originColumn < 0 || record.textOffset > textLength
+                || record.textLength > textLength - record.textOffset) {
+            error("Spreadsheet::loadSnapshot: bad template record");
+        }
+    }
+    for (uint64_t i = 0; i < cellCount; i++) {
+        const SnapshotCell& record = cellRecords[i];
+        if (record.row < 0 || record.column < 0
+                || record.formula < -1 || record.formula >= (int64_t) templateCount
+                || ((record.flags & SNAPSHOT_STORED) != 0 && record.formula != -1)
+                || record.firstPrecedent + (uint64_t) record.precedentCount > precedentCount
+                || record.firstRange + (uint64_t) record.rangeCount > rangeCount) {
+            error("Spreadsheet::loadSnapshot: bad cell record");
+        }
+        if (i > 0 && !(CellRef(cellRecords[i - 1].row, cellRecords[i - 1].column)
+                       < CellRef(record.row, record.column))) {
+            error("Spreadsheet::loadSnapshot: cells out of order");
+        }
+    }
+    for (uint64_t i = 0; i < precedentCount; i++) {
+        if (precedents[i] >= cellCount) {
+            error("Spreadsheet::loadSnapshot: bad precedent");
+        }
+    }
+    for (uint64_t i = 0; i < rangeCount; i++) {
+        if (ranges[i].startRow < 0 || ranges[i].startColumn < 0
+                || ranges[i].endRow < 0 || ranges[i].endColumn < 0) {
+            error("Spreadsheet::loadSnapshot: bad range");
+        }
+    }
+
+    clear();
+    try {
+        // templates are parsed once each; every cell after the first to use
+        // one adds a user
+        Vector<FormulaTemplate*> formulas;
+        Vector<int> uses((int) templateCount, 0);
+        for (uint64_t i = 0; i < templateCount; i++) {
+            const SnapshotTemplate& record = templateRecords[i];
+            string rawText(text + record.textOffset, record.textLength);
+            formulas.add(acquireTemplate(rawText, CellRef(record.originRow, record.originColumn)));
+        }
+
+        // the nodes, with their values and places in the order as saved
+        Vector<CellNode*> nodes;
+        for (uint64_t i = 0; i < cellCount; i++) {
+            const SnapshotCell& record = cellRecords[i];
+            bool created;
+            CellNode* cell = cells.findOrCreate(CellRef(record.row, record.column), created);
+            *cell->value = record.value;
+            cell->stored = (record.flags & SNAPSHOT_STORED) != 0;
+            cell->order = record.order;
+            lowestOrder = min(lowestOrder, record.order);
+            highestOrder = max(highestOrder, record.order);
+            if (record.formula >= 0) {
+                if (uses[record.formula]++ > 0) {
+                    formulas[record.formula]->addUser();
+                }
+                cell->formula = formulas[record.formula];
+            }
+            nodes.add(cell);
+        }
+
+        // then the edges between them, which need no cycle checks
+        for (uint64_t i = 0; i < cellCount; i++) {
+            const SnapshotCell& record = cellRecords[i];
+            CellNode* cell = nodes[i];
+            for (uint32_t j = 0; j < record.precedentCount; j++) {
+                CellNode* precedent = nodes[precedents[record.firstPrecedent + j]];
+                cell->precedents.add(precedent);
+                precedent->dependents.add(cell);
+            }
+            for (uint32_t j = 0; j < record.rangeCount; j++) {
+                const SnapshotRange& range = ranges[record.firstRange + j];
+                Range cellRange(CellRef(range.startRow, range.startColumn),
+                                CellRef(range.endRow, range.endColumn));
+                rangeIndex.add(cellRange, cell);
+                cell->ranges.add(cellRange);
+            }
+        }
+        for (uint64_t i = 0; i < templateCount; i++) {
+            if (uses[i] == 0) {
+                releaseTemplate(formulas[i]);
+            }
+        }
+
+        for (uint64_t i = 0; i < cellCount; i++) {
+            CellNode* cell = nodes[i];
+            if (cell->formula != nullptr) {
+                // every cell a formula names must have been saved with it
+                bindCell(cell);
+                int count = cell->formula->getProgram()->getBindingCount();
+                for (int j = 0; j < count; j++) {
+                    if (cell->bindings[j] == nullptr) {
+                        error("Spreadsheet::loadSnapshot: missing precedent of "
+                              + cell->ref.toString());
+                    }
+                }
+            }
+            if (cellRecords[i].flags & SNAPSHOT_DIRTY) {
+                cell->dirty = true;
+                dirtyCount++;
+                staleCells.add(cell);
+            }
+        }
+        for (CellNode* cell : nodes) {
+            if ((cell->formula != nullptr || cell->stored) && (!lazy || !cell->dirty)) {
+                display(cell);
+            }
+        }
+    } catch (ErrorException&) {
+        clear();
+        throw;
+    }
+    if (journal != nullptr) {
+        compactJournal();
+    }
+}
+
+void Spreadsheet::openJournal(const string& filename) {
+    // bring the sheet back to its last committed state: the snapshot, if
+    // there is one, with every change journaled since applied on top as one
+    // batch; a journaled clear starts again from an empty sheet instead
+    closeJournal();
+    std::vector<JournalRecord> records;
+    Journal::readRecords(filename, records);
+    size_t start = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].type == JournalRecord::CLEAR) {
+            start = i + 1;
+        }
+    }
+    if (start == 0 && ifstream(filename.c_str()).good()) {
+        loadSnapshot(filename);
+    } else {
+        clear();
+    }
+    Vector<pair<string, string> > edits;
+    for (size_t i = start; i < records.size(); i++) {
+        edits.add(make_pair(records[i].cell.toString(), records[i].rawText));
+    }
+    if (!edits.isEmpty()) {
+        setCells(edits);
+    }
+
+    // from now on every committed change is journaled; what was replayed
+    // is folded into a fresh snapshot in the background
+    journal = new Journal(filename);
+    if (!records.empty()) {
+        compactJournal();
     }
 }
 
+void Spreadsheet::closeJournal() {
+    // wait for any compaction, sync the journal and stop journaling
+    delete journal;
+    journal = nullptr;
+}
+
+void Spreadsheet::compactJournal() {
+    // serialize the sheet here and let the journal write it out
+    if (journal == nullptr) {
+        error("no journal is open");
+    }
+    ostringstream snapshot;
+    saveSnapshot(snapshot);
+    journal->compact(snapshot.str());
+}
+
+void Spreadsheet::syncJournal() {
+    // make every committed change durable now rather than within the
+    // journal's sync interval
+    if (journal == nullptr) {
+        error("no journal is open");
+    }
+    journal->sync();
+}
+
+void Spreadsheet::refreshDisplay() {
+    // recompute and redisplay every cell whose display is out of date
+    Vector<CellNode*> stale;
+    for (CellNode* cell : staleCells) {
+        stale.add(cell);
+    }
+    for (CellNode* cell : stale) {
+        display(cell);
+    }
+}
+
+void Spreadsheet::rollback() {
+    // drop the queued edits without applying any of them
+    if (!batching) {
+        error("no batch is in progress");
+    }
+    pendingEdits.clear();
+    batching = false;
+}
+
 void Spreadsheet::save(ostream& outfile) const {
 
-    // traverse the vertices and output them into the format
-    for (VertexV<Expression*>* vertex : cellGraph.getVertexSet()) {
-        if (vertex->data != nullptr) {
-            outfile << vertex->name
-                    << " " << vertex->data->getRawText()
-                    << endl;
+    // output the set cells row by row in the format
+    Vector<pair<CellRef, CellNode*> > saved;
+    Vector<CellNode*> nodes;
+    cells.getNodes(nodes);
+    for (CellNode* cell : nodes) {
+        if (cell->formula != nullptr || cell->stored) {
+            saved.add(make_pair(cell->ref, cell));
+        }
+    }
+    sort(saved.begin(), saved.end());
+    for (const pair<CellRef, CellNode*>& entry : saved) {
+        CellNode* cell = entry.second;
+        outfile << entry.first
+                << " " << (cell->stored ? storedRawText(*cell->value)
+                                        : cell->formula->getRawText(entry.first))
+                << endl;
+    }
+}
+
+void Spreadsheet::exportCsv(ostream& outfile) const {
+    // write one record per row from row 1 to the last row in use, each with
+    // a field per column up to the last column in use: the computed value of
+    // each cell, or the text of a text cell.  The output is built up in a
+    // buffer and written in large blocks rather than flushed line by line.
+    Vector<pair<CellRef, CellNode*> > exported;
+    Vector<CellNode*> nodes;
+    cells.getNodes(nodes);
+    int columnCount = 0;
+    for (CellNode* cell : nodes) {
+        if (cell->formula != nullptr || cell->stored) {
+            exported.add(make_pair(cell->ref, cell));
+            columnCount = max(columnCount, cell->ref.getColumn() + 1);
+        }
+    }
+    sort(exported.begin(), exported.end());
+
+    string buffer;
+    buffer.reserve(CSV_BLOCK_SIZE * 2);
+    int row = 0;
+    int column = 0;
+    for (const pair<CellRef, CellNode*>& entry : exported) {
+        for (; row < entry.first.getRow(); row++) {
+            buffer.append(columnCount - 1 - column, ',');
+            buffer += '\n';
+            column = 0;
+        }
+        buffer.append(entry.first.getColumn() - column, ',');
+        column = entry.first.getColumn();
+        CellNode* cell = entry.second;
+        const Expression* exp = cell->stored ? nullptr : cell->formula->getExpression();
+        if (exp != nullptr && !exp->isFormula() && exp->getType() == TEXTSTRING) {
+            string text = cell->formula->getRawText(cell->ref);
+            if (text.find_first_of(",\"\r\n") == string::npos) {
+                buffer += text;
+            } else {
+                buffer += '"';
+                for (char ch : text) {
+                    buffer += ch;
+                    if (ch == '"') buffer += '"';
+                }
+                buffer += '"';
+            }
+        } else {
+            char number[MAX_CSV_NUMBER_LENGTH + 1];
+            buffer.append(number, formatCsvNumber(getCellCalculatedValue(cell->ref), number));
+        }
+        if (buffer.length() >= CSV_BLOCK_SIZE) {
+            outfile.write(buffer.data(), buffer.length());
+            buffer.clear();
+        }
+    }
+    if (!exported.isEmpty()) {
+        buffer.append(columnCount - 1 - column, ',');
+        buffer += '\n';
+    }
+    outfile.write(buffer.data(), buffer.length());
+}
+
+// a CSV field as a quoted text cell, such as "\"=HYPERLINK(x)\"" for
+// "=HYPERLINK(x)"; a backslash would escape the closing quote, so a trailing
+// run of them is doubled
+static string quoteCsvText(const string& text) {
+    size_t end = text.find_last_not_of('\\') + 1;
+    return "\"" + text + string(text.length() - end, '\\') + "\"";
+}
+
+void Spreadsheet::importCsv(const string& filename) {
+    // fill the sheet from a CSV file, one record per row from A1 down: a
+    // field that is a number is stored straight into the grid with no
+    // formula, an empty field leaves its cell empty, and any other field
+    // becomes a text cell, with line breaks in it turned into spaces; one
+    // that would read as a formula, or not read at all, is kept as text by
+    // quoting it.  On any error the sheet is left empty.
+    MappedFile file(filename);
+    clear();
+    try {
+        CsvScanner scanner(file.getData(), file.getSize());
+        CsvField field;
+        Vector<CellNode*> imported;
+        int row = scanner.getRecord();
+        int column = 0;
+        while (scanner.nextField(field)) {
+            if (field.length > 0) {
+                CellNode* cell = addCell(CellRef(row, column), false);
+                double value;
+                if (parseCsvNumber(field.text, field.length, value)) {
+                    *cell->value = value;
+                    cell->stored = true;
+                } else {
+                    string text = field.toString();
+                    replace(text.begin(), text.end(), '\r', ' ');
+                    replace(text.begin(), text.end(), '\n', ' ');
+                    FormulaTemplate* formula = nullptr;
+                    try {
+                        formula = acquireTemplate(text, cell->ref);
+                    } catch (exception&) {
+                        // such as an unterminated quote
+                    }
+                    if (formula == nullptr || formula->getExpression()->isFormula()) {
+                        if (formula != nullptr) {
+                            releaseTemplate(formula);
+                        }
+                        try {
+                            formula = acquireTemplate(quoteCsvText(text), cell->ref);
+                        } catch (exception&) {
+                            error("invalid input:" + text);
+                        }
+                    }
+                    cell->formula = formula;
+                    bindCell(cell);
+                    evaluate(cell);
+                }
+                imported.add(cell);
+            }
+            column = field.endsRecord ? 0 : column + 1;
+            row = scanner.getRecord();
+        }
+        lastRecalcCount = 0;
+        for (CellNode* cell : imported) {
+            display(cell);
         }
+    } catch (ErrorException&) {
+        clear();
+        throw;
+    }
+    if (journal != nullptr) {
+        compactJournal();
+    }
+}
 
+// whether the cell is a plain number that an archive can keep as a double:
+// an imported value, or a number written the way formatCsvNumber writes it
+static bool isArchivedNumber(const CellNode* cell) {
+    if (cell->stored) {
+        return true;
+    }
+    const Expression* exp = cell->formula->getExpression();
+    if (exp->isFormula() || exp->getType() != DOUBLE) {
+        return false;
     }
+    string rawText = cell->formula->getRawText(cell->ref);
+    double value;
+    char buffer[MAX_CSV_NUMBER_LENGTH + 1];
+    return parseCsvNumber(rawText.data(), rawText.length(), value)
+            && rawText == string(buffer, formatCsvNumber(value, buffer));
+}
+
+void Spreadsheet::saveArchive(ostream& outfile) const {
+    // write the set cells column by column through an ArchiveWriter:
+    // - the template dictionary: for each template, the cell and raw text
+    //   of the first cell saved with it;
+    // - for each column in use, its distance from the last one, its number
+    //   of cells, the rows of the cells as distances from the row above
+    //   less one, each cell's template number (0 for a number), and then
+    //   the values of its numbers as raw doubles.
+    Vector<CellNode*> nodes;
+    cells.getNodes(nodes);
+    std::vector<CellNode*> saved;
+    for (CellNode* cell : nodes) {
+        if (cell->formula != nullptr || cell->stored) {
+            saved.push_back(cell);
+        }
+    }
+    sort(saved.begin(), saved.end(), [](const CellNode* a, const CellNode* b) {
+        return a->ref.getColumn() != b->ref.getColumn()
+                ? a->ref.getColumn() < b->ref.getColumn()
+                : a->ref.getRow() < b->ref.getRow();
+    });
+
+    // number the templates in the order their first cells are saved
+    std::vector<uint64_t> numbers(saved.size(), 0);
+    std::unordered_map<const FormulaTemplate*, uint64_t> templateNumbers;
+    std::vector<const CellNode*> origins;
+    for (size_t i = 0; i < saved.size(); i++) {
+        if (isArchivedNumber(saved[i])) continue;
+        auto found = templateNumbers.find(saved[i]->formula);
+        if (found == templateNumbers.end()) {
+            origins.push_back(saved[i]);
+            found = templateNumbers.insert(make_pair(saved[i]->formula, origins.size())).first;
+        }
+        numbers[i] = found->second;
+    }
+
+    ArchiveWriter writer(outfile);
+    writer.putVarint(origins.size());
+    for (const CellNode* origin : origins) {
+        writer.putVarint(origin->ref.getRow());
+        writer.putVarint(origin->ref.getColumn());
+        writer.putString(origin->formula->getRawText(origin->ref));
+    }
+    int columnCount = 0;
+    for (size_t i = 0; i < saved.size(); i++) {
+        columnCount += i == 0 || saved[i]->ref.getColumn() != saved[i - 1]->ref.getColumn();
+    }
+    writer.putVarint(columnCount);
+    int previousColumn = 0;
+    for (size_t start = 0, end; start < saved.size(); start = end) {
+        int column = saved[start]->ref.getColumn();
+        for (end = start; end < saved.size() && saved[end]->ref.getColumn() == column; end++) {}
+        writer.putVarint(column - previousColumn);
+        writer.putVarint(end - start);
+        int previousRow = -1;
+        for (size_t i = start; i < end; i++) {
+            writer.putVarint(saved[i]->ref.getRow() - previousRow - 1);
+            previousRow = saved[i]->ref.getRow();
+        }
+        for (size_t i = start; i < end; i++) {
+            writer.putVarint(numbers[i]);
+        }
+        for (size_t i = start; i < end; i++) {
+            if (numbers[i] == 0) {
+                writer.putDouble(*saved[i]->value);
+            }
+        }
+        previousColumn = column;
+    }
+    writer.finish();
+}
+
+// reads a row or column number from an archive
+static int getArchivedIndex(ArchiveReader& reader, uint64_t base) {
+    uint64_t value = base + reader.getVarint();
+    if (value > (uint64_t) INT_MAX) {
+        error("Spreadsheet::loadArchive: bad cell in archive");
+    }
+    return (int) value;
+}
+
+void Spreadsheet::loadArchive(istream& infile) {
+    // read the archive a block at a time, building the templates and cells
+    // as they come, then link and evaluate the sheet once, as load does
+    clear();
+    try {
+        ArchiveReader reader(infile);
+        uint64_t templateCount = reader.getVarint();
+        Vector<FormulaTemplate*> formulas;
+        Vector<int> uses;
+        for (uint64_t i = 0; i < templateCount; i++) {
+            int row = getArchivedIndex(reader, 0);
+            int column = getArchivedIndex(reader, 0);
+            string rawText = reader.getString();
+            try {
+                formulas.add(acquireTemplate(rawText, CellRef(row, column)));
+            } catch (exception&) {
+                error("invalid input:" + rawText);
+            }
+            uses.add(0);
+        }
+
+        Vector<CellNode*> edited;
+        uint64_t columnCount = reader.getVarint();
+        int column = 0;
+        std::vector<uint64_t> numbers;
+        for (uint64_t i = 0; i < columnCount; i++) {
+            int previousColumn = column;
+            column = getArchivedIndex(reader, column);
+            if (i > 0 && column == previousColumn) {
+                error("Spreadsheet::loadArchive: bad cell in archive");
+            }
+            uint64_t count = reader.getVarint();
+            int start = edited.size();
+            int row = -1;
+            for (uint64_t j = 0; j < count; j++) {
+                row = getArchivedIndex(reader, (uint64_t) row + 1);
+                edited.add(addCell(CellRef(row, column), false));
+            }
+            numbers.clear();
+            for (uint64_t j = 0; j < count; j++) {
+                numbers.push_back(reader.getVarint());
+            }
+            for (uint64_t j = 0; j < count; j++) {
+                CellNode* cell = edited[start + j];
+                if (numbers[j] == 0) {
+                    *cell->value = reader.getDouble();
+                    cell->stored = true;
+                } else if (numbers[j] <= templateCount) {
+                    // each acquired template starts with one user
+                    if (uses[numbers[j] - 1]++ > 0) {
+                        formulas[numbers[j] - 1]->addUser();
+                    }
+                    cell->formula = formulas[numbers[j] - 1];
+                } else {
+                    error("Spreadsheet::loadArchive: bad template number");
+                }
+            }
+        }
+        reader.finish();
+        for (int i = 0; i < formulas.size(); i++) {
+            if (uses[i] == 0) {
+                releaseTemplate(formulas[i]);
+            }
+        }
+        linkCells(edited);
+    } catch (ErrorException&) {
+        clear();
+        throw;
+    }
+    if (journal != nullptr) {
+        compactJournal();
+    }
+}
+
+// pads the output with zeros up to the next 8-byte boundary
+static void alignSnapshot(ostream& outfile, uint64_t& offset) {
+    static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    outfile.write(zeros, (8 - offset % 8) % 8);
+    offset += (8 - offset % 8) % 8;
+}
+
+void Spreadsheet::saveSnapshot(ostream& outfile) const {
+    // every node in cell order, so a precedent's index can be searched for
+    Vector<CellNode*> nodes;
+    cells.getNodes(nodes);
+    sort(nodes.begin(), nodes.end(), [](const CellNode* a, const CellNode* b) {
+        return a->ref < b->ref;
+    });
+    Vector<CellRef> refs;
+    for (const CellNode* cell : nodes) {
+        refs.add(cell->ref);
+    }
+
+    // each template is stored as the raw text of the first cell using it
+    std::unordered_map<const FormulaTemplate*, int> templateIndexes;
+    std::vector<SnapshotTemplate> templateRecords;
+    std::vector<SnapshotCell> cellRecords;
+    std::vector<uint32_t> precedents;
+    std::vector<SnapshotRange> ranges;
+    string text;
+    for (const CellNode* cell : nodes) {
+        SnapshotCell record;
+        memset(&record, 0, sizeof(record));
+        record.row = cell->ref.getRow();
+        record.column = cell->ref.getColumn();
+        record.value = *cell->value;
+        record.order = cell->order;
+        record.formula = -1;
+        if (cell->formula != nullptr) {
+            auto found = templateIndexes.find(cell->formula);
+            if (found == templateIndexes.end()) {
+                string rawText = cell->formula->getRawText(cell->ref);
+                SnapshotTemplate formula;
+                formula.originRow = record.row;
+                formula.originColumn = record.column;
+                formula.textOffset = text.length();
+                formula.textLength = rawText.length();
+                text += rawText;
+                found = templateIndexes.insert(make_pair(cell->formula,
+                                                         (int) templateRecords.size())).first;
+                templateRecords.push_back(formula);
+            }
+            record.formula = found->second;
+        }
+        record.firstPrecedent = precedents.size();
+        record.precedentCount = cell->precedents.size();
+        for (const CellNode* precedent : cell->precedents) {
+            precedents.push_back(lower_bound(refs.begin(), refs.end(), precedent->ref)
+                                 - refs.begin());
+        }
+        record.firstRange = ranges.size();
+        record.rangeCount = cell->ranges.size();
+        for (const Range& range : cell->ranges) {
+            SnapshotRange saved;
+            saved.startRow = range.getStartRow();
+            saved.startColumn = range.getStartColumn();
+            saved.endRow = range.getEndRow();
+            saved.endColumn = range.getEndColumn();
+            ranges.push_back(saved);
+        }
+        record.flags = (cell->dirty ? SNAPSHOT_DIRTY : 0) | (cell->stored ? SNAPSHOT_STORED : 0);
+        cellRecords.push_back(record);
+    }
+
+    // lay the sections out one after another behind the header
+    const void* data[SNAPSHOT_SECTION_COUNT] = {
+        templateRecords.data(), cellRecords.data(), precedents.data(), ranges.data(), text.data()
+    };
+    size_t recordSizes[SNAPSHOT_SECTION_COUNT] = {
+        sizeof(SnapshotTemplate), sizeof(SnapshotCell), sizeof(uint32_t), sizeof(SnapshotRange), 1
+    };
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.sections[SNAPSHOT_TEMPLATES].count = templateRecords.size();
+    header.sections[SNAPSHOT_CELLS].count = cellRecords.size();
+    header.sections[SNAPSHOT_PRECEDENTS].count = precedents.size();
+    header.sections[SNAPSHOT_RANGES].count = ranges.size();
+    header.sections[SNAPSHOT_TEXT].count = text.length();
+    uint64_t offset = sizeof(header);
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        offset += (8 - offset % 8) % 8;
+        header.sections[i].offset = offset;
+        offset += header.sections[i].count * recordSizes[i];
+    }
+
+    offset = sizeof(header);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        alignSnapshot(outfile, offset);
+        size_t bytes = header.sections[i].count * recordSizes[i];
+        outfile.write(static_cast<const char*>(data[i]), bytes);
+        offset += bytes;
+    }
+    outfile.flush();
 }
 
 void Spreadsheet::setCell(const string& cellname, const string& rawText) {
 
-    Expression* exp;
-    // parse rawText into expression object
-    try{
-        exp = Parser::parseExpression(rawText);
-    } catch(exception ex) {
-        error("invalid input:" + rawText);
+    if (batching) {
+        pendingEdits.add(make_pair(cellname, rawText));
+        return;
+    }
+
+    // a single edit is a batch of one
+    Vector<pair<string, string> > edits;
+    edits.add(make_pair(cellname, rawText));
+    setCells(edits);
+}
+
+void Spreadsheet::setCells(const Vector<pair<string, string> >& edits) {
+    // a later edit of the same cell replaces an earlier one
+    Vector<CellRef> refs;
+    Map<CellRef, string> texts;
+    for (const pair<string, string>& edit : edits) {
+        CellRef ref;
+        if (!CellRef::parse(edit.first, ref)) {
+            error("invalid cell name: " + edit.first);
+        }
+        if (!texts.containsKey(ref)) {
+            refs.add(ref);
+        }
+        texts.put(ref, edit.second);
+    }
+
+    // parse everything before touching the sheet; cells whose formulas have
+    // the same shape share one template
+    Vector<FormulaTemplate*> formulas;
+    for (const CellRef& ref : refs) {
+        try {
+            formulas.add(acquireTemplate(texts[ref], ref));
+        } catch (exception&) {
+            for (FormulaTemplate* formula : formulas) {
+                releaseTemplate(formula);
+            }
+            error("invalid input:" + texts[ref]);
+        }
+    }
+
+    // first remove all out-bound, old edges of every edited cell, so that
+    // only cycles present in the final sheet are reported
+    Vector<CellNode*> edited;
+    Vector<FormulaTemplate*> oldFormulas;
+    Vector<Vector<CellNode*> > oldPrecedents;
+    Vector<Vector<Range> > oldRanges;
+    for (const CellRef& ref : refs) {
+        CellNode* cell = addCell(ref, false);
+        edited.add(cell);
+        oldPrecedents.add(cell->precedents);
+        oldRanges.add(cell->ranges);
+        oldFormulas.add(cell->formula);
+        removeEdge(cell);
+    }
+
+    // add the new edges, keeping the topological order up to date
+    Vector<CellNode*> cycle;
+    for (int i = 0; i < edited.size() && cycle.isEmpty(); i++) {
+        edited[i]->formula = formulas[i];
+        setCellHelper(formulas[i], formulas[i]->getExpression(), edited[i], cycle);
+    }
+    if (!cycle.isEmpty()) {
+        // put every edited cell back the way it was
+        restoreEdges(edited, oldPrecedents, oldRanges);
+        for (int i = 0; i < edited.size(); i++) {
+            edited[i]->formula = oldFormulas[i];
+            releaseTemplate(formulas[i]);
+        }
+        string path = cycle[0]->ref.toString();
+        for (int i = 1; i < cycle.size(); i++) {
+            path += " -> " + cycle[i]->ref.toString();
+        }
+        error("circular reference: " + path);
+    }
+    // bind the new formulas now that every cell they name has a node; the
+    // old templates are kept until the batch has been evaluated
+    Vector<CellNode*> storedCells;
+    for (int i = 0; i < edited.size(); i++) {
+        if (oldFormulas[i] != nullptr) {
+            unbindCell(edited[i], oldFormulas[i]);
+        }
+        if (edited[i]->stored) {
+            storedCells.add(edited[i]);
+            edited[i]->stored = false;
+        }
+        bindCell(edited[i]);
+    }
+
+    // evaluate the cells and everything dependent on them, and display them;
+    // lazily, only mark the dependents stale, to be recomputed when read
+    Vector<CellNode*> order;
+    if (lazy) {
+        order = edited;
+    } else {
+        collectDependents(edited, order);
+    }
+    Vector<double> oldValues;
+    for (CellNode* cell : order) {
+        oldValues.add(*cell->value);
+    }
+    try {
+        if (lazy) {
+            for (CellNode* cell : edited) {
+                markDirty(cell);
+            }
+            for (CellNode* cell : edited) {
+                display(cell);
+            }
+        } else {
+            recalculate(order);
+        }
+        // journal the batch as one group; if it cannot be written it is
+        // undone like an edit that cannot be evaluated
+        if (journal != nullptr) {
+            for (const CellRef& ref : refs) {
+                journal->appendSetCell(ref, texts[ref]);
+            }
+            journal->commit();
+        }
+    } catch (ErrorException&) {
+        // an edit that cannot be evaluated or journaled undoes the whole batch
+        Vector<Vector<Range> > newRanges;
+        for (int i = 0; i < edited.size(); i++) {
+            newRanges.add(edited[i]->ranges);
+            unbindCell(edited[i], formulas[i]);
+        }
+        restoreEdges(edited, oldPrecedents, oldRanges);
+        for (int i = 0; i < edited.size(); i++) {
+            edited[i]->formula = oldFormulas[i];
+            if (oldFormulas[i] != nullptr) {
+                bindCell(edited[i]);
+            }
+            releaseTemplate(formulas[i]);
+        }
+        for (CellNode* cell : storedCells) {
+            cell->stored = true;
+        }
+        for (int i = 0; i < order.size(); i++) {
+            double value = *order[i]->value;
+            *order[i]->value = oldValues[i];
+            updateIndexes(order[i], value);
+        }
+        pruneOrderIndexes(newRanges);
+        if (lazy) {
+            // the cells are shown again when the sheet is next refreshed
+            for (CellNode* cell : edited) {
+                markDirty(cell);
+            }
+        }
+        for (CellNode* cell : order) {
+            if (cell->formula == nullptr && !cell->stored) {
+                // a cell that was empty before the batch
+                if (cell->dirty) {
+                    cell->dirty = false;
+                    dirtyCount--;
+                    staleCells.remove(cell);
+                }
+                view->displayCell(cell->ref, "");
+            } else if (!lazy) {
+                display(cell);
+            }
+        }
+        throw;
+    }
+    for (int i = 0; i < edited.size(); i++) {
+        if (oldFormulas[i] != nullptr) {
+            releaseTemplate(oldFormulas[i]);
+        }
+    }
+    pruneOrderIndexes(oldRanges);
+
+    // fold a long journal into the snapshot once it costs more to replay
+    // than to rewrite
+    if (journal != nullptr && journal->getSize() > MAX_JOURNAL_SIZE) {
+        compactJournal();
+    }
+}
+
+void Spreadsheet::restoreEdges(const Vector<CellNode*>& edited,
+                               const Vector<Vector<CellNode*> >& oldPrecedents,
+                               const Vector<Vector<Range> >& oldRanges) {
+    // replace the edges of the edited cells with the ones they had before
+    for (CellNode* cell : edited) {
+        removeEdge(cell);
+    }
+    for (int i = 0; i < edited.size(); i++) {
+        Vector<CellNode*> unused;
+        for (CellNode* precedent : oldPrecedents[i]) {
+            addDependency(edited[i], precedent, unused);
+        }
+        for (const Range& range : oldRanges[i]) {
+            addRangeDependency(edited[i], range, unused);
+        }
+    }
+}
+
+void Spreadsheet::setLazyEvaluation(bool lazy) {
+    this->lazy = lazy;
+    if (!lazy) {
+        // bring everything left stale by lazy mode back up to date
+        refreshDisplay();
+    }
+}
+
+void Spreadsheet::setThreadCount(int threadCount) {
+    // one thread means serial recalculation on the calling thread
+    if (threadCount < 1) {
+        error("thread count must be at least 1");
     }
+    if (threadCount == getThreadCount()) return;
+    delete pool;
+    pool = nullptr;
+    if (threadCount > 1) {
+        pool = new ThreadPool(threadCount);
+    }
+}
 
-    // check if the cell exists or not, if not add it
-    if (!cellGraph.containsVertex(cellname)) {
-        cellGraph.addVertex(cellname);
+double Spreadsheet::aggregateFromRange(const Range& range, IndexedFunction function) {
+    // tall ranges are answered column by column from the column indexes,
+    // anything else by scanning the values
+    refreshRange(range);
+    int startRow = range.getStartRow();
+    int endRow = range.getEndRow();
+    if (endRow - startRow + 1 < MIN_INDEXED_RANGE_HEIGHT
+            || range.getStartColumn() > range.getEndColumn()) {
+        return aggregate(function, RangeView(cells, range));
     }
+    double result = 0.0;
+    for (int col = range.getStartColumn(); col <= range.getEndColumn(); col++) {
+        double partial;
+        ColumnIndex* index = getColumnIndex(function, col, endRow);
+        if (index != nullptr) {
+            partial = index->query(startRow, endRow);
+        } else {
+            Range column(CellRef(startRow, col), CellRef(endRow, col));
+            partial = aggregate(function, RangeView(cells, column));
+        }
+        result = col == range.getStartColumn() ? partial
+                 : ColumnIndex::combine(function, result, partial);
+    }
+    return result;
+}
 
-    // make sure not create a circle
-    if (checkCircle(exp, cellname)) {
-        error("circular reference");
+double Spreadsheet::percentileFromRange(const Range& range, double k) {
+    // ranges of at least MIN_ORDER_INDEXED_SIZE cells are answered from an
+    // order index kept up to date as cells change; smaller ones select from
+    // a copy of their values
+    refreshRange(range);
+    int64_t rows = range.getEndRow() - range.getStartRow() + 1;
+    int64_t cols = range.getEndColumn() - range.getStartColumn() + 1;
+    if (rows > 0 && cols > 0 && rows * cols >= MIN_ORDER_INDEXED_SIZE) {
+        OrderIndex* index = getOrderIndex(range);
+        if (index != nullptr) {
+            return index->percentile(k);
+        }
     }
+    Vector<double> values;
+    cells.getValuesInRange(range, values);
+    return percentile(values, k);
+}
 
-    // first remove all out-bound, old edges
-    removeEdge(cellname);
-    // add edges and evaluate the cell
-    setCellHelper(exp, cellname);
-    cellGraph.getVertex(cellname)->data = exp;
-    cellGraph.getVertex(cellname)->data->eval(*this);
+CellNode* Spreadsheet::findCell(const string& cellname) const {
+    // the node of the named cell, or nullptr if it was never set or named
+    CellRef ref;
+    if (!CellRef::parse(cellname, ref)) {
+        return nullptr;
+    }
+    return cells.find(ref);
+}
 
-    // update the cells dependent on it and display them
-    updateCellHelper(cellname);
+FormulaTemplate* Spreadsheet::acquireTemplate(const string& rawText, const CellRef& ref) {
+    // reuse the template of any cell with the same normalized text, even one
+    // no longer in use, and only parse the text if there is none
+    string key;
+    try {
+        key = FormulaTemplate::normalize(rawText, ref);
+    } catch (ErrorException&) {
+        // let the parser say what is wrong with the text
+        delete Parser::parseExpression(rawText, &arena);
+        throw;
+    }
+    FormulaTemplate* formula = templates.get(key);
+    if (formula != nullptr) {
+        parseCacheHits++;
+        if (formula->getUserCount() == 0) {
+            unusedTemplateCount--;
+        }
+        formula->addUser();
+        return formula;
+    }
+    parseCacheMisses++;
+    Expression* exp = Parser::parseExpression(rawText, &arena);
+    formula = new (&arena) FormulaTemplate(exp, ref, key);
+    templates.put(key, formula);
+    return formula;
+}
 
-    // display
-    display(cellname);
+void Spreadsheet::releaseTemplate(FormulaTemplate* formula) {
+    // keep a template once no cell uses it, until there are too many such
+    if (formula->removeUser() > 0) return;
+    unusedTemplateCount++;
+    if (unusedTemplateCount > MAX_UNUSED_TEMPLATES) {
+        freeUnusedTemplates();
+    }
+}
+
+void Spreadsheet::freeUnusedTemplates() {
+    // free every template that no cell uses
+    Vector<string> unused;
+    for (const string& key : templates) {
+        if (templates[key]->getUserCount() == 0) {
+            unused.add(key);
+        }
+    }
+    for (const string& key : unused) {
+        delete templates[key];
+        templates.remove(key);
+    }
+    unusedTemplateCount = 0;
+}
+
+void Spreadsheet::bindCell(CellNode* cell) {
+    // look up the node of every cell the formula names, as seen from this one
+    const Program* program = cell->formula->getProgram();
+    int count = program->getBindingCount();
+    if (count == 0) return;
+    cell->bindings = static_cast<CellNode**>(arena.allocate(count * sizeof(CellNode*)));
+    for (int i = 0; i < count; i++) {
+        cell->bindings[i] = cells.find(cell->formula->shift(program->getBinding(i), cell->ref));
+    }
+}
+
+void Spreadsheet::unbindCell(CellNode* cell, const FormulaTemplate* formula) {
+    // free the bindings made for the given template
+    int count = formula->getProgram()->getBindingCount();
+    arena.release(cell->bindings, count * sizeof(CellNode*));
+    cell->bindings = nullptr;
 }
 
-void Spreadsheet::setCellHelper(Expression*& exp, const string& cellname) {
+bool Spreadsheet::setCellHelper(const FormulaTemplate* formula, const Expression* exp,
+                                CellNode* cell, Vector<CellNode*>& cycle) {
 
-    // find all its dependency and add edges
-    // not add duplicate edges
+    // find all its dependency and add edges, with the template's cell names
+    // shifted to this cell; stop at the first edge that would close a cycle
     if (exp->getType() == COMPOUND) {
         // like "=A1+B2", just keep traversing down
-        Expression* left = (Expression*) exp->getLeft();
-        Expression* right = (Expression*)  exp->getRight();
-        setCellHelper(left, cellname);
-        setCellHelper(right, cellname);
+        return setCellHelper(formula, exp->getLeft(), cell, cycle)
+            && setCellHelper(formula, exp->getRight(), cell, cycle);
     } else if (exp->getType() == RANGE) {
-        // like "=SUM(C3:C8)", stop going down and add edges
-        Range range = exp->getRange();
-        int startRow = range.getStartRow();
-        int startCol = range.getStartColumn();
-        int endRow = range.getEndRow();
-        int endCol = range.getEndColumn();
-        // loop over all the cells involved
-        for (int i = startCol; i <= endCol; i++ ) {
-            for (int j = startRow; j <= endRow; j++) {
-                string newcellname = Range::toCellName(j, i);
-
-                if (!cellGraph.containsVertex(newcellname)) {
-                    cellGraph.addVertex(newcellname);
+        // like "=SUM(C3:C8)", stop going down and record the whole range
+        return addRangeDependency(cell, formula->shift(exp->getRange(), cell->ref), cycle);
+    } else if (exp->getType() == IDENTIFIER) {
+        // identifier like "=A1", add an edge
+        CellNode* precedent = addCell(formula->shift(exp->getCellRef(), cell->ref), true);
+        return addDependency(cell, precedent, cycle);
+    }
+    return true;
+}
+
+void Spreadsheet::addEdges(const FormulaTemplate* formula, const Expression* exp,
+                           CellNode* cell) {
+    // add the edges of the cell as setCellHelper does, but without keeping
+    // the order up to date or looking for cycles; sortTopologically does
+    // both for the whole sheet afterwards
+    if (exp->getType() == COMPOUND) {
+        addEdges(formula, exp->getLeft(), cell);
+        addEdges(formula, exp->getRight(), cell);
+    } else if (exp->getType() == RANGE) {
+        Range range = formula->shift(exp->getRange(), cell->ref);
+        rangeIndex.add(range, cell);
+        cell->ranges.add(range);
+    } else if (exp->getType() == IDENTIFIER) {
+        CellNode* precedent = addCell(formula->shift(exp->getCellRef(), cell->ref), true);
+        if (!precedent->dependents.contains(cell)) {
+            cell->precedents.add(precedent);
+            precedent->dependents.add(cell);
+        }
+    }
+}
+
+bool Spreadsheet::sortTopologically(const Vector<CellNode*>& roots, Vector<CellNode*>& order,
+                                    Vector<CellNode*>& cycle) {
+    // renumber every cell so that its precedents come first, by a depth-first
+    // search from each root, and list them in that order; a cell met again
+    // while still on the search path closes a cycle, which is reported as
+    // in orderBefore.  The order field marks cells: 0 for not yet seen and
+    // -1 for on the path.
+    Vector<CellNode*> nodes;
+    cells.getNodes(nodes);
+    for (CellNode* cell : nodes) {
+        cell->order = 0;
+    }
+    std::vector<CellNode*> pending;     // precedents still to visit, per frame
+    std::vector<pair<CellNode*, size_t> > path;   // cell, start in pending
+    int next = 0;
+    for (CellNode* root : roots) {
+        if (root->order != 0) continue;
+        root->order = -1;
+        path.push_back(make_pair(root, pending.size()));
+        Vector<CellNode*> precedents;
+        getPrecedents(root, precedents);
+        pending.insert(pending.end(), precedents.begin(), precedents.end());
+        while (!path.empty()) {
+            if (pending.size() == path.back().second) {
+                // every precedent is done, so this cell is too
+                CellNode* cell = path.back().first;
+                path.pop_back();
+                cell->order = ++next;
+                order.add(cell);
+                continue;
+            }
+            CellNode* cell = pending.back();
+            pending.pop_back();
+            if (cell->order == -1) {
+                size_t start = path.size() - 1;
+                while (path[start].first != cell) {
+                    start--;
                 }
-                if (!cellGraph.containsEdge(cellname, newcellname)) {
-                    cellGraph.addEdge(cellname, newcellname);
+                for (size_t i = start; i < path.size(); i++) {
+                    cycle.add(path[i].first);
                 }
+                cycle.add(cell);
+                return false;
+            } else if (cell->order == 0) {
+                cell->order = -1;
+                path.push_back(make_pair(cell, pending.size()));
+                precedents.clear();
+                getPrecedents(cell, precedents);
+                pending.insert(pending.end(), precedents.begin(), precedents.end());
             }
         }
+    }
+    lowestOrder = 1;
+    highestOrder = next;
+    return true;
+}
 
-    } else if (exp->getType() == IDENTIFIER) {
-        // identifier like "=A1", add an edge
-        string newcellname = exp->toString();
-        if (!cellGraph.containsVertex(newcellname)){
-            cellGraph.addVertex(newcellname);
+CellNode* Spreadsheet::addCell(const CellRef& ref, bool isPrecedent) {
+    // a new cell has no edges yet, so it can go at either end of the
+    // topological order; putting referenced cells first and edited cells
+    // last keeps the usual fill-down edits from reordering anything.  A cell
+    // inside a range some formula reads must come before that formula.
+    bool created;
+    CellNode* cell = cells.findOrCreate(ref, created);
+    if (created) {
+        if (isPrecedent || rangeIndex.covers(ref.getRow(), ref.getColumn())) {
+            cell->order = --lowestOrder;
+        } else {
+            cell->order = ++highestOrder;
         }
-        if (!cellGraph.containsEdge(cellname, newcellname)) {
-            cellGraph.addEdge(cellname, newcellname);
+    }
+    return cell;
+}
+
+bool Spreadsheet::addDependency(CellNode* cell, CellNode* precedent,
+                                Vector<CellNode*>& cycle) {
+    // add the edge cell -> precedent for a reference such as "=A1"
+    if (precedent->dependents.contains(cell)) {
+        return true;
+    }
+    if (cell == precedent) {
+        cycle.add(cell);
+        cycle.add(cell);
+        return false;
+    }
+    if (!orderBefore(precedent, cell, cycle)) {
+        return false;
+    }
+    cell->precedents.add(precedent);
+    precedent->dependents.add(cell);
+    return true;
+}
+
+bool Spreadsheet::addRangeDependency(CellNode* cell, const Range& range,
+                                     Vector<CellNode*>& cycle) {
+    // record that the cell reads the range; only the existing cells inside
+    // it take part in the ordering, since a cell created there later is put
+    // ahead of every formula by addCell
+    int row = cell->ref.getRow();
+    int col = cell->ref.getColumn();
+    if (range.getStartRow() <= row && row <= range.getEndRow()
+            && range.getStartColumn() <= col && col <= range.getEndColumn()) {
+        cycle.add(cell);
+        cycle.add(cell);
+        return false;
+    }
+    Vector<CellNode*> nodes;
+    getCellsInRange(range, nodes);
+    for (CellNode* precedent : nodes) {
+        if (!orderBefore(precedent, cell, cycle)) {
+            return false;
         }
     }
+    rangeIndex.add(range, cell);
+    cell->ranges.add(range);
+    return true;
 }
 
-void Spreadsheet::updateCellHelper(const string& cellname) {
-    // update the dependent cells
-    for (VertexV<Expression*>* invNeighbor : cellGraph.getInverseNeighbors(cellname)) {
-        string newcellname = invNeighbor->name;
-        invNeighbor->data->eval(*this);
-        // display
-        display(newcellname);
-        updateCellHelper(newcellname); 
+bool Spreadsheet::orderBefore(CellNode* precedent, CellNode* cell,
+                              Vector<CellNode*>& cycle) {
+    // make sure precedent comes before cell in the topological order, as
+    // needed before cell may depend on it (Pearce-Kelly); only cells ordered
+    // between the two are searched or moved.  Fails with the cycle if
+    // precedent already depends on cell.
+    int lower = cell->order;
+    int upper = precedent->order;
+    if (upper < lower) {
+        return true;
     }
 
-    // itself
-    cellGraph.getVertex(cellname)->data->eval(*this);
-    // display
-    display(cellname);
+    // cells depending on cell that are ordered before precedent; if
+    // precedent itself is among them the new edge closes a cycle
+    Vector<CellNode*> forward;
+    Map<CellNode*, CellNode*> parent;
+    Stack<CellNode*> stack;
+    stack.push(cell);
+    parent.put(cell, nullptr);
+    while (!stack.isEmpty()) {
+        CellNode* node = stack.pop();
+        forward.add(node);
+        Vector<CellNode*> dependents;
+        getDependents(node, dependents);
+        for (CellNode* next : dependents) {
+            if (next == precedent) {
+                // report the references: cell -> precedent -> ... -> cell
+                cycle.add(cell);
+                cycle.add(precedent);
+                for (CellNode* step = node; step != cell; step = parent.get(step)) {
+                    cycle.add(step);
+                }
+                cycle.add(cell);
+                return false;
+            }
+            if (!parent.containsKey(next) && next->order <= upper) {
+                parent.put(next, node);
+                stack.push(next);
+            }
+        }
+    }
+
+    // precedents of precedent that are ordered after cell
+    Vector<CellNode*> backward;
+    Set<CellNode*> seen;
+    stack.push(precedent);
+    seen.add(precedent);
+    while (!stack.isEmpty()) {
+        CellNode* node = stack.pop();
+        backward.add(node);
+        Vector<CellNode*> precedents;
+        getPrecedents(node, precedents);
+        for (CellNode* next : precedents) {
+            if (!seen.contains(next) && next->order >= lower) {
+                seen.add(next);
+                stack.push(next);
+            }
+        }
+    }
+
+    // reuse the positions of both sets: backward cells first, then forward
+    // cells, each keeping its current relative order
+    Vector<pair<int, CellNode*> > before, after;
+    Vector<int> positions;
+    for (CellNode* node : backward) {
+        before.add(make_pair(node->order, node));
+        positions.add(node->order);
+    }
+    for (CellNode* node : forward) {
+        after.add(make_pair(node->order, node));
+        positions.add(node->order);
+    }
+    sort(before.begin(), before.end());
+    sort(after.begin(), after.end());
+    sort(positions.begin(), positions.end());
+    int next = 0;
+    for (const pair<int, CellNode*>& entry : before) {
+        entry.second->order = positions[next++];
+    }
+    for (const pair<int, CellNode*>& entry : after) {
+        entry.second->order = positions[next++];
+    }
+    return true;
 }
 
-void Spreadsheet::removeEdge(const string& cellname) {
-    // remove all the existing, out-bound edges since the rawtext changes
-    for (VertexV<Expression*>* neighbor : cellGraph.getNeighbors(cellname)) {
-        Expression* exp = neighbor->data;
-        cellGraph.removeEdge(cellGraph.getVertex(cellname), neighbor);
+void Spreadsheet::getDependents(const CellNode* cell, Vector<CellNode*>& dependents) const {
+    // cells naming this one directly, then cells reading a range around it
+    for (CellNode* dependent : cell->dependents) {
+        dependents.add(dependent);
     }
+    rangeIndex.findOwners(cell->ref.getRow(), cell->ref.getColumn(), dependents);
 }
 
-bool Spreadsheet::checkCircle(Expression*& exp, const string& cellname){
-    // return true if there is a circle.
-    if (exp->getType() == COMPOUND) {
-        // like "=A1+B2", just keep traversing down
-        Expression* left = (Expression*)  exp->getLeft();
-        Expression* right = (Expression*)  exp->getRight();
-        return checkCircle(left, cellname) || checkCircle(right, cellname);
-    } else if (exp->getType() == RANGE) {
-        // like "=SUM(C3:C8)", loop over each and do the recursion
-        Range range = exp->getRange();
-        int startRow = range.getStartRow();
-        int startCol = range.getStartColumn();
-        int endRow = range.getEndRow();
-        int endCol = range.getEndColumn();
-        // loop over all the cells involved
-        for (int i = startCol; i <= endCol; i++ ) {
-            for (int j = startRow; j <= endRow; j++) {
-                string newcellname = Range::toCellName(j, i);
-                if (cellname == newcellname) return true;
-                // go down more layers of cells
-                else if ( cellGraph.containsVertex(newcellname) &&
-                    cellGraph.getVertex(newcellname)->data != nullptr &&
-                    checkCircle(cellGraph.getVertex(newcellname)->data, cellname)) {
-                    return true;
+void Spreadsheet::getPrecedents(const CellNode* cell, Vector<CellNode*>& precedents) const {
+    // cells named directly by this one, then the existing cells of its ranges
+    for (CellNode* precedent : cell->precedents) {
+        precedents.add(precedent);
+    }
+    for (const Range& range : cell->ranges) {
+        getCellsInRange(range, precedents);
+    }
+}
+
+void Spreadsheet::getCellsInRange(const Range& range, Vector<CellNode*>& nodes) const {
+    // the existing cells of the range; empty tiles are skipped by the grid
+    cells.getNodesInRange(range, nodes);
+}
+
+void Spreadsheet::refreshRange(const Range& range) {
+    // bring any stale cells of the range up to date
+    if (dirtyCount > 0) {
+        Vector<CellNode*> nodes;
+        getCellsInRange(range, nodes);
+        for (CellNode* cell : nodes) {
+            if (cell->dirty) {
+                refreshCell(cell);
+            }
+        }
+    }
+}
+
+ColumnIndex* Spreadsheet::getColumnIndex(IndexedFunction function, int column, int endRow) {
+    // the index of the function over the column, built or grown from the
+    // grid so that it covers endRow; while a level is being evaluated in
+    // parallel the indexes may only be read, so nullptr is returned instead
+    HashMap<int, ColumnIndex*>& indexes = columnIndexes[function];
+    ColumnIndex* index = indexes.get(column);
+    if (index != nullptr && endRow < index->getCapacity()) {
+        return index;
+    }
+    if (inParallelLevel) {
+        return nullptr;
+    }
+    int capacity = index == nullptr ? 1 : index->getCapacity();
+    while (capacity <= endRow) {
+        capacity *= 2;
+    }
+    Vector<double> values;
+    cells.getValuesInRange(Range(CellRef(0, column), CellRef(capacity - 1, column)), values);
+    delete index;
+    index = new ColumnIndex(function, values);
+    indexes.put(column, index);
+    return index;
+}
+
+OrderIndex* Spreadsheet::getOrderIndex(const Range& range) {
+    // the order index of the range, built from the grid on first use; while
+    // a level is being evaluated in parallel the indexes may only be read,
+    // so nullptr is returned instead
+    pair<CellRef, CellRef> key = make_pair(range.getStart(), range.getEnd());
+    if (orderIndexes.containsKey(key)) {
+        return orderIndexes.get(key);
+    }
+    if (inParallelLevel) {
+        return nullptr;
+    }
+    Vector<double> values;
+    cells.getValuesInRange(range, values);
+    OrderIndex* index = new OrderIndex(range, values);
+    orderIndexes.put(key, index);
+    orderIndexRanges.add(range, index);
+    return index;
+}
+
+void Spreadsheet::pruneOrderIndexes(const Vector<Vector<Range> >& ranges) {
+    // drop the order indexes of ranges that no formula reads any more
+    if (orderIndexes.isEmpty()) return;
+    for (const Vector<Range>& cellRanges : ranges) {
+        for (const Range& range : cellRanges) {
+            pair<CellRef, CellRef> key = make_pair(range.getStart(), range.getEnd());
+            if (!orderIndexes.containsKey(key) || rangeIndex.contains(range)) {
+                continue;
+            }
+            OrderIndex* index = orderIndexes.get(key);
+            orderIndexes.remove(key);
+            orderIndexRanges.remove(range, index);
+            delete index;
+        }
+    }
+}
+
+void Spreadsheet::updateIndexes(const CellNode* cell, double oldValue) {
+    // keep the indexes covering the cell, if any, in step with its new
+    // value; column index rows past their capacity are read from the grid
+    // whenever they grow, and only the order indexes whose ranges contain
+    // the cell are looked at
+    int row = cell->ref.getRow();
+    int col = cell->ref.getColumn();
+    double value = *cell->value;
+    for (const HashMap<int, ColumnIndex*>& indexes : columnIndexes) {
+        if (indexes.isEmpty()) continue;
+        ColumnIndex* index = indexes.get(col);
+        if (index != nullptr && row < index->getCapacity()) {
+            index->set(row, value);
+        }
+    }
+    if (orderIndexRanges.size() > 0 && memcmp(&value, &oldValue, sizeof(double)) != 0) {
+        Vector<OrderIndex*> indexes;
+        orderIndexRanges.findOwners(row, col, indexes);
+        for (OrderIndex* index : indexes) {
+            index->replace(oldValue, value);
+        }
+    }
+}
+
+void Spreadsheet::recalculate(const Vector<CellNode*>& order) {
+    // evaluate and display each cell of a dependent cone once, in the
+    // topological order given by collectDependents
+    if (pool != nullptr && order.size() >= MIN_PARALLEL_LEVEL_SIZE) {
+        evaluateInParallel(order);
+        for (CellNode* cell : order) {
+            display(cell);
+        }
+    } else {
+        for (CellNode* cell : order) {
+            if (cell->formula != nullptr) {
+                evaluate(cell);
+                display(cell);
+            }
+        }
+    }
+    lastRecalcCount = order.size();
+}
+
+void Spreadsheet::evaluate(CellNode* cell) {
+    // store the new value in the grid, where range scans read it; during a
+    // parallel level the indexes are brought up to date afterwards
+    if (cell->formula != nullptr) {
+        double oldValue = *cell->value;
+        *cell->value = cell->formula->run(*this, cell);
+        if (!inParallelLevel) {
+            updateIndexes(cell, oldValue);
+        }
+    }
+}
+
+int Spreadsheet::findRun(const Vector<CellNode*>& order, int start, int maxLength) const {
+    // the number of cells from order[start] on that share its formula and
+    // follow it row by row down its column, none reading an earlier one;
+    // stale cells could be read, so lazy sheets only ever get runs of one
+    CellNode* first = order[start];
+    if (first->formula == nullptr || dirtyCount > 0) {
+        return 1;
+    }
+    int column = first->ref.getColumn();
+    int firstRow = first->ref.getRow();
+    int end = start + 1;
+    while (end < order.size() && end - start < maxLength) {
+        CellNode* cell = order[end];
+        int row = cell->ref.getRow();
+        if (cell->formula != first->formula || cell->ref.getColumn() != column
+                || row != firstRow + (end - start)) {
+            break;
+        }
+        // order is topological, so only reads of the rows above can clash
+        bool reads = false;
+        for (CellNode* precedent : cell->precedents) {
+            reads = reads || (precedent->ref.getColumn() == column
+                              && precedent->ref.getRow() >= firstRow
+                              && precedent->ref.getRow() < row);
+        }
+        for (const Range& range : cell->ranges) {
+            reads = reads || (range.getStartColumn() <= column && column <= range.getEndColumn()
+                              && range.getStartRow() < row && firstRow <= range.getEndRow());
+        }
+        if (reads) break;
+        end++;
+    }
+    return end - start;
+}
+
+void Spreadsheet::sortForRuns(Vector<CellNode*>& nodes) {
+    // order the cells by formula, then column, then row; the keys are
+    // gathered up front so the sort does not chase node pointers, and a
+    // level that is already in order, or in reverse order as a column
+    // often is, is not sorted at all
+    struct RunKey {
+        FormulaTemplate* formula;
+        int64_t position;
+        CellNode* cell;
+        bool operator <(const RunKey& other) const {
+            if (formula != other.formula) return less<FormulaTemplate*>()(formula, other.formula);
+            return position < other.position;
+        }
+    };
+    vector<RunKey> keys;
+    keys.reserve(nodes.size());
+    for (CellNode* cell : nodes) {
+        int64_t position = ((int64_t) cell->ref.getColumn() << 32)
+                           | (uint32_t) cell->ref.getRow();
+        keys.push_back({cell->formula, position, cell});
+    }
+    if (is_sorted(keys.rbegin(), keys.rend())) {
+        reverse(keys.begin(), keys.end());
+    } else if (!is_sorted(keys.begin(), keys.end())) {
+        sort(keys.begin(), keys.end());
+    }
+    for (int i = 0; i < nodes.size(); i++) {
+        nodes[i] = keys[i].cell;
+    }
+}
+
+void Spreadsheet::evaluateRun(CellNode* const* run, int count) {
+    // like evaluate for each cell of a run found by findRun, with the
+    // formula evaluated for the whole run at once; if that fails, the cells
+    // are evaluated one at a time so the error surfaces from the same cell
+    Vector<double> results(count);
+    try {
+        run[0]->formula->runBatch(*this, cells, run[0], count, &results[0]);
+    } catch (ErrorException&) {
+        for (int i = 0; i < count; i++) {
+            evaluate(run[i]);
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        double oldValue = *run[i]->value;
+        *run[i]->value = results[i];
+        if (!inParallelLevel) {
+            updateIndexes(run[i], oldValue);
+        }
+    }
+}
+
+void Spreadsheet::evaluateInParallel(const Vector<CellNode*>& order) {
+    // a cell's level is the length of the longest dependency path leading to
+    // it inside the cone; cells on one level never read each other, so each
+    // level can be evaluated concurrently once the previous one is done,
+    // giving exactly the values a serial pass would
+    HashMap<CellNode*, int> level;
+    Vector<Vector<CellNode*> > levels;
+    for (CellNode* cell : order) {
+        int depth = level.get(cell);
+        if (depth == levels.size()) {
+            levels.add(Vector<CellNode*>());
+        }
+        if (cell->formula != nullptr) {
+            levels[depth].add(cell);
+        }
+        Vector<CellNode*> dependents;
+        getDependents(cell, dependents);
+        for (CellNode* dependent : dependents) {
+            if (level.get(dependent) < depth + 1) {
+                level.put(dependent, depth + 1);
+            }
+        }
+    }
+
+    for (Vector<CellNode*>& cellsOnLevel : levels) {
+        // for the same reason the cells of a level can go in any order;
+        // sorting brings the cells sharing a formula down a column together,
+        // so that each task evaluates a whole run of them at once
+        if (cellsOnLevel.size() >= MIN_BATCH_RUN) {
+            sortForRuns(cellsOnLevel);
+        }
+        Vector<pair<int, int> > runs;
+        for (int i = 0; i < cellsOnLevel.size(); i += runs[runs.size() - 1].second) {
+            runs.add(make_pair(i, findRun(cellsOnLevel, i, MAX_BATCH_RUN)));
+        }
+        auto evaluateRunAt = [this, &cellsOnLevel, &runs](int i) {
+            int start = runs[i].first;
+            int length = runs[i].second;
+            if (length >= MIN_BATCH_RUN) {
+                evaluateRun(&cellsOnLevel[start], length);
+            } else {
+                for (int k = start; k < start + length; k++) {
+                    evaluate(cellsOnLevel[k]);
                 }
             }
+        };
+        if (cellsOnLevel.size() < MIN_PARALLEL_LEVEL_SIZE) {
+            for (int i = 0; i < runs.size(); i++) {
+                evaluateRunAt(i);
+            }
+        } else {
+            Vector<double> oldValues;
+            for (CellNode* cell : cellsOnLevel) {
+                oldValues.add(*cell->value);
+            }
+            inParallelLevel = true;
+            exception_ptr failure;
+            try {
+                pool->run(runs.size(), evaluateRunAt);
+            } catch (...) {
+                failure = current_exception();
+            }
+            inParallelLevel = false;
+            for (int i = 0; i < cellsOnLevel.size(); i++) {
+                updateIndexes(cellsOnLevel[i], oldValues[i]);
+            }
+            if (failure) {
+                rethrow_exception(failure);
+            }
         }
-    } else if (exp->getType() == IDENTIFIER) {
-        // identifier like "=A1", add an edge
-        string newcellname = exp->toString();
-        if (newcellname == cellname) return true;
-        else if ( cellGraph.containsVertex(newcellname) &&
-            cellGraph.getVertex(newcellname)->data != nullptr &&
-            checkCircle(cellGraph.getVertex(newcellname)->data, cellname)) {
-            return true;
+    }
+}
+
+bool Spreadsheet::collectDependents(const Vector<CellNode*>& roots, Vector<CellNode*>& order) {
+    // iterative depth-first search over the inverse edges; a cell is finished
+    // only after everything depending on it, so the reversed finishing order
+    // puts every cell before its dependents.  Cells visited but not yet
+    // finished form the current search path, so reaching one is a cycle.
+    Set<CellNode*> visited;
+    Set<CellNode*> finishedSet;
+    Vector<CellNode*> finished;
+    Stack<pair<CellNode*, bool> > stack;
+    for (int i = roots.size() - 1; i >= 0; i--) {
+        stack.push(make_pair(roots[i], false));
+    }
+    while (!stack.isEmpty()) {
+        pair<CellNode*, bool> top = stack.pop();
+        if (top.second) {
+            finished.add(top.first);
+            finishedSet.add(top.first);
+            continue;
+        }
+        if (visited.contains(top.first)) continue;
+        visited.add(top.first);
+        stack.push(make_pair(top.first, true));
+        Vector<CellNode*> dependents;
+        getDependents(top.first, dependents);
+        for (CellNode* dependent : dependents) {
+            if (!visited.contains(dependent)) {
+                stack.push(make_pair(dependent, false));
+            } else if (!finishedSet.contains(dependent)) {
+                return false;
+            }
+        }
+    }
+    for (int i = finished.size() - 1; i >= 0; i--) {
+        order.add(finished[i]);
+    }
+    return true;
+}
+
+void Spreadsheet::markDirty(CellNode* cell) {
+    // mark the cell and its dependent cone stale; the dependents of a dirty
+    // cell are always dirty already, so the search stops at dirty cells
+    Stack<CellNode*> stack;
+    stack.push(cell);
+    while (!stack.isEmpty()) {
+        CellNode* node = stack.pop();
+        if (node->dirty) continue;
+        node->dirty = true;
+        dirtyCount++;
+        staleCells.add(node);
+        Vector<CellNode*> dependents;
+        getDependents(node, dependents);
+        for (CellNode* dependent : dependents) {
+            if (!dependent->dirty) {
+                stack.push(dependent);
+            }
         }
     }
-    return false;
 }
 
-void Spreadsheet::display(const string& cellname) {
-    if (!cellGraph.getVertex(cellname)->data->isFormula()) {
-        // if not formula, display rawText
-        if ( cellGraph.getVertex(cellname)->data->getType() == TEXTSTRING) {
-            // if it is textstring, isformula is not good enough for "=1" case
-            view->displayCell(cellname, cellGraph.getVertex(cellname)->data->getRawText());
+void Spreadsheet::refreshCell(CellNode* cell) {
+    // evaluate the dirty precedents of the cell, then the cell itself; a cell
+    // is finished only after its precedents, so the finishing order is
+    // already an evaluation order
+    Set<CellNode*> visited;
+    Vector<CellNode*> order;
+    Stack<pair<CellNode*, bool> > stack;
+    stack.push(make_pair(cell, false));
+    while (!stack.isEmpty()) {
+        pair<CellNode*, bool> top = stack.pop();
+        if (top.second) {
+            order.add(top.first);
+            continue;
         }
-        else {
-            view->displayCell(cellname, realToString(getCellCalculatedValue(cellname)));
+        if (visited.contains(top.first)) continue;
+        visited.add(top.first);
+        stack.push(make_pair(top.first, true));
+        Vector<CellNode*> precedents;
+        getPrecedents(top.first, precedents);
+        for (CellNode* precedent : precedents) {
+            if (precedent->dirty && !visited.contains(precedent)) {
+                stack.push(make_pair(precedent, false));
+            }
         }
     }
-    else {
-        // If is formula, display the value
-        double displayValue = cellGraph.getVertex(cellname)->data->getValue();
-        view->displayCell(cellname, realToString(displayValue));
+    for (CellNode* node : order) {
+        evaluate(node);
+        if (node->dirty) {
+            node->dirty = false;
+            dirtyCount--;
+        }
+    }
+    lastRecalcCount = order.size();
+}
+
+void Spreadsheet::removeEdge(CellNode* cell) {
+    // remove all the existing, out-bound edges since the rawtext changes
+    for (CellNode* precedent : cell->precedents) {
+        precedent->dependents.remove(cell);
+    }
+    cell->precedents.clear();
+    // and forget the ranges it reads
+    for (const Range& range : cell->ranges) {
+        rangeIndex.remove(range, cell);
+    }
+    cell->ranges.clear();
+}
+
+void Spreadsheet::display(CellNode* cell) {
+    if (cell->dirty) {
+        refreshCell(cell);
+    }
+    staleCells.remove(cell);
+    if (cell->stored) {
+        view->displayCell(cell->ref, realToString(*cell->value));
+        return;
+    }
+    const Expression* exp = cell->formula->getExpression();
+    if (!exp->isFormula() && exp->getType() == TEXTSTRING) {
+        // if it is textstring, isformula is not good enough for "=1" case
+        view->displayCell(cell->ref, cell->formula->getRawText(cell->ref));
+    } else {
+        // otherwise display the value
+        view->displayCell(cell->ref, realToString(*cell->value));
     }
 }
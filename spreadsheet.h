@@ -7,8 +7,18 @@
 #include "range.h"
 #include "vector.h"
 #include "view.h"
-#include "basicgraph.h"
+#include "set.h"
+#include "arena.h"
+#include "cellgrid.h"
+#include "columnindex.h"
+#include "hashmap.h"
+#include "map.h"
+#include "orderindex.h"
 #include "expression.h"
+#include "formulatemplate.h"
+#include "journal.h"
+#include "rangeindex.h"
+#include "threadpool.h"
 using namespace std;
 
 class Spreadsheet {
@@ -16,24 +26,105 @@ public:
     Spreadsheet(View* view);
     ~Spreadsheet();
 
+    void beginBatch();
     bool cellIsFormula(const string& cellname) const;
     void clear();
-    void fillFromRange(const Range& range, Vector<double>& values);
+    void closeJournal();
+    void commit();
+    void compactJournal();
+    void exportCsv(ostream& outfile) const;
+    double aggregateFromRange(const Range& range, IndexedFunction function);
+    double percentileFromRange(const Range& range, double k);
+    double stdevFromRange(const Range& range);
     double getCellCalculatedValue(const string& cellname) const;
+    double getCellCalculatedValue(const CellRef& cell) const;
+    int getLastRecalcCount() const;
+    int getParseCacheHits() const;
+    int getParseCacheMisses() const;
+    int getThreadCount() const;
     string getCellRawText(const string& cellname) const;
+    void importCsv(const string& filename);
+    bool isBatching() const;
+    bool isLazyEvaluation() const;
     void load(istream& infile);
+    void loadArchive(istream& infile);
+    void loadSnapshot(const string& filename);
+    void openJournal(const string& filename);
+    void refreshDisplay();
+    void rollback();
     void save(ostream& outfile) const;
+    void saveArchive(ostream& outfile) const;
+    void saveSnapshot(ostream& outfile) const;
     void setCell(const string& cellname, const string& rawText);
+    void setCells(const Vector<pair<string, string> >& edits);
+    void setLazyEvaluation(bool lazy);
+    void setThreadCount(int threadCount);
+    void syncJournal();
 
 private:
 
-    BasicGraphV<Expression*> cellGraph;
+    Arena arena;
+    CellGrid cells;
     View* view;
-    void setCellHelper(Expression*& exp, const string& cellname);
-    void updateCellHelper(const string& cellname);
-    void removeEdge(const string& cellname);
-    bool checkCircle(Expression*& exp, const string& cellname);
-    void display(const string& cellname);
+    int lastRecalcCount;
+    bool lazy;
+    int dirtyCount;
+    Set<CellNode*> staleCells;
+    ThreadPool* pool;
+    bool batching;
+    Vector<pair<string, string> > pendingEdits;
+    int lowestOrder;
+    int highestOrder;
+    RangeIndex<CellNode> rangeIndex;
+    HashMap<int, ColumnIndex*> columnIndexes[INDEXED_FUNCTION_COUNT];
+    Map<pair<CellRef, CellRef>, OrderIndex*> orderIndexes;
+    RangeIndex<OrderIndex> orderIndexRanges;
+    HashMap<string, FormulaTemplate*> templates;
+    Vector<Arena*> parseArenas;
+    int unusedTemplateCount;
+    int parseCacheHits;
+    int parseCacheMisses;
+    bool inParallelLevel;
+    Journal* journal;
+    CellNode* findCell(const string& cellname) const;
+    CellNode* addCell(const CellRef& ref, bool isPrecedent);
+    FormulaTemplate* acquireTemplate(const string& rawText, const CellRef& ref);
+    void releaseTemplate(FormulaTemplate* formula);
+    void freeUnusedTemplates();
+    void bindCell(CellNode* cell);
+    void unbindCell(CellNode* cell, const FormulaTemplate* formula);
+    bool setCellHelper(const FormulaTemplate* formula, const Expression* exp,
+                       CellNode* cell, Vector<CellNode*>& cycle);
+    void restoreEdges(const Vector<CellNode*>& edited,
+                      const Vector<Vector<CellNode*> >& oldPrecedents,
+                      const Vector<Vector<Range> >& oldRanges);
+    void loadCells(const string& text);
+    void linkCells(const Vector<CellNode*>& edited);
+    void addEdges(const FormulaTemplate* formula, const Expression* exp, CellNode* cell);
+    bool sortTopologically(const Vector<CellNode*>& roots, Vector<CellNode*>& order,
+                           Vector<CellNode*>& cycle);
+    bool addDependency(CellNode* cell, CellNode* precedent, Vector<CellNode*>& cycle);
+    bool addRangeDependency(CellNode* cell, const Range& range, Vector<CellNode*>& cycle);
+    bool orderBefore(CellNode* precedent, CellNode* cell, Vector<CellNode*>& cycle);
+    void getDependents(const CellNode* cell, Vector<CellNode*>& dependents) const;
+    void getPrecedents(const CellNode* cell, Vector<CellNode*>& precedents) const;
+    void getCellsInRange(const Range& range, Vector<CellNode*>& nodes) const;
+    void refreshRange(const Range& range);
+    ColumnIndex* getColumnIndex(IndexedFunction function, int column, int endRow);
+    OrderIndex* getOrderIndex(const Range& range);
+    void pruneOrderIndexes(const Vector<Vector<Range> >& ranges);
+    void updateIndexes(const CellNode* cell, double oldValue);
+    void recalculate(const Vector<CellNode*>& order);
+    bool collectDependents(const Vector<CellNode*>& roots, Vector<CellNode*>& order);
+    void evaluate(CellNode* cell);
+    static void sortForRuns(Vector<CellNode*>& nodes);
+    int findRun(const Vector<CellNode*>& order, int start, int maxLength) const;
+    void evaluateRun(CellNode* const* run, int count);
+    void evaluateInParallel(const Vector<CellNode*>& order);
+    void markDirty(CellNode* cell);
+    void refreshCell(CellNode* cell);
+    void removeEdge(CellNode* cell);
+    void display(CellNode* cell);
 
 };
 
@@ -20,6 +20,9 @@
 #include "private/platform.h"
 
 const std::string Stanford123Gui::WINDOW_TITLE = "Stanford 1-2-3";
+const std::string Stanford123Gui::SNAPSHOT_EXTENSION = ".s123";
+const std::string Stanford123Gui::CSV_EXTENSION = ".csv";
+const std::string Stanford123Gui::ARCHIVE_EXTENSION = ".a123";
 const std::string Stanford123Gui::FONT_PLAIN = "SansSerif-Plain-12";
 const std::string Stanford123Gui::EMPTY_STATUS_MESSAGE = "<html>&nbsp;</html>";
 
@@ -145,11 +148,21 @@ void Stanford123Gui::load() {
         return;
     }
 
+    // binary snapshots and CSV files are mapped by the model rather than
+    // read as text
     std::ifstream infile;
     infile.open(filename.c_str(), std::ios_base::binary | std::ios_base::in);
     if (!infile.fail()) {
         table->clear();
-        model->load(infile);
+        if (endsWith(filename, SNAPSHOT_EXTENSION)) {
+            model->loadSnapshot(filename);
+        } else if (endsWith(filename, CSV_EXTENSION)) {
+            model->importCsv(filename);
+        } else if (endsWith(filename, ARCHIVE_EXTENSION)) {
+            model->loadArchive(infile);
+        } else {
+            model->load(infile);
+        }
         infile.close();
         setStatusMessage("Data loaded from " + getTail(filename) + ".");
         window->setTitle(WINDOW_TITLE + " - " + getTail(filename));
@@ -284,7 +297,15 @@ void Stanford123Gui::save() {
     std::ofstream outfile;
     outfile.open(filename.c_str(), std::ios_base::binary | std::ios_base::out);
     if (!outfile.fail()) {
-        model->save(outfile);
+        if (endsWith(filename, SNAPSHOT_EXTENSION)) {
+            model->saveSnapshot(outfile);
+        } else if (endsWith(filename, CSV_EXTENSION)) {
+            model->exportCsv(outfile);
+        } else if (endsWith(filename, ARCHIVE_EXTENSION)) {
+            model->saveArchive(outfile);
+        } else {
+            model->save(outfile);
+        }
         outfile.close();
         setStatusMessage("Data saved to " + getTail(filename) + ".");
         window->setTitle(WINDOW_TITLE + " - " + getTail(filename));
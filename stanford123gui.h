@@ -150,6 +150,15 @@ private:
     static const std::string EMPTY_STATUS_MESSAGE;
     static const std::string WINDOW_TITLE;
 
+    // files ending in this are binary snapshots rather than .123 text
+    static const std::string SNAPSHOT_EXTENSION;
+
+    // files ending in this are imported and exported as CSV values
+    static const std::string CSV_EXTENSION;
+
+    // files ending in this are compressed columnar archives
+    static const std::string ARCHIVE_EXTENSION;
+
 
     // set to false to see errors bubble out to console (default true)
     static const bool CATCH_ERRORS = false;
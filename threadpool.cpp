@@ -0,0 +1,164 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file implements the threadpool.h interface.
+ */
+
+#include "threadpool.h"
+#include <stdint.h>
+
+ThreadPool::ThreadPool(int threadCount)
+        : currentTask(nullptr),
+          remaining(0),
+          active(0),
+          generation(0),
+          stopping(false) {
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    for (int i = 0; i < threadCount; i++) {
+        queues.push_back(new WorkQueue());
+    }
+    // worker 0 is whichever thread calls run()
+    for (int i = 1; i < threadCount; i++) {
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (WorkQueue* queue : queues) {
+        delete queue;
+    }
+}
+
+int ThreadPool::getThreadCount() const {
+    return (int) queues.size();
+}
+
+void ThreadPool::run(int taskCount, const std::function<void(int)>& task) {
+    if (taskCount <= 0) {
+        return;
+    }
+    if (threads.empty()) {
+        for (int i = 0; i < taskCount; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        currentTask = &task;
+        remaining = taskCount;
+        // deal the tasks out in contiguous blocks, one block per worker
+        int workerCount = (int) queues.size();
+        for (int w = 0; w < workerCount; w++) {
+            int begin = (int) ((int64_t) taskCount * w / workerCount);
+            int end = (int) ((int64_t) taskCount * (w + 1) / workerCount);
+            std::lock_guard<std::mutex> queueGuard(queues[w]->lock);
+            for (int i = begin; i < end; i++) {
+                queues[w]->tasks.push_back(i);
+            }
+        }
+        generation++;
+    }
+    workAvailable.notify_all();
+
+    runTasks(0);
+
+    std::exception_ptr error;
+    {
+        // wait until every task is done and no worker still holds the task
+        std::unique_lock<std::mutex> guard(stateLock);
+        workFinished.wait(guard, [this]() {
+            return remaining == 0 && active == 0;
+        });
+        currentTask = nullptr;
+        error = failure;
+        failure = nullptr;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool ThreadPool::popTask(int worker, int& task) {
+    // a worker takes its own most recently dealt task first
+    WorkQueue* queue = queues[worker];
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->tasks.empty()) {
+        return false;
+    }
+    task = queue->tasks.back();
+    queue->tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::stealTask(int worker, int& task) {
+    // steal from the opposite end of another worker's queue
+    int workerCount = (int) queues.size();
+    for (int i = 1; i < workerCount; i++) {
+        WorkQueue* victim = queues[(worker + i) % workerCount];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->tasks.empty()) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTasks(int worker) {
+    // no tasks are added during a run, so once every queue is empty
+    // there is nothing left for this worker to do
+    int task;
+    while (popTask(worker, task) || stealTask(worker, task)) {
+        try {
+            (*currentTask)(task);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(stateLock);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> guard(stateLock);
+            workFinished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop(int worker) {
+    int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(stateLock);
+            workAvailable.wait(guard, [this, &seen]() {
+                return stopping || generation != seen;
+            });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            if (currentTask == nullptr) {
+                // woke up after that run had already finished
+                continue;
+            }
+            active++;
+        }
+        runTasks(worker);
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            active--;
+        }
+        workFinished.notify_all();
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * CS 106B/X Stanford 1-2-3
+ * This file declares the ThreadPool type that the spreadsheet uses to
+ * evaluate independent cells concurrently.
+ */
+
+#ifndef _threadpool_h
+#define _threadpool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size pool of worker threads with work stealing.
+ * Each call to run() deals a batch of task indexes out to per-worker
+ * queues; a worker takes tasks from the back of its own queue and, once
+ * that runs dry, steals from the front of the other workers' queues.
+ * The thread calling run() takes part as worker 0, so a pool with a
+ * thread count of 1 runs every task on the caller.
+ */
+class ThreadPool {
+public:
+    /**
+     * Constructs a pool that runs tasks on the given number of threads,
+     * including the caller of run().  Counts below 1 are treated as 1.
+     */
+    ThreadPool(int threadCount);
+
+    /**
+     * Stops and joins all worker threads.
+     */
+    ~ThreadPool();
+
+    /**
+     * Returns the number of threads that execute tasks, including the caller.
+     */
+    int getThreadCount() const;
+
+    /**
+     * Calls task(i) once for every i in [0, taskCount) and returns when all
+     * calls have finished.  Calls may run concurrently and in any order.
+     * If any call throws, the first exception is rethrown here after the
+     * remaining tasks have finished.
+     */
+    void run(int taskCount, const std::function<void(int)>& task);
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<WorkQueue*> queues;
+
+    std::mutex stateLock;
+    std::condition_variable workAvailable;
+    std::condition_variable workFinished;
+    const std::function<void(int)>* currentTask;
+    std::atomic<int> remaining;
+    int active;
+    int generation;
+    bool stopping;
+    std::exception_ptr failure;
+
+    bool popTask(int worker, int& task);
+    bool stealTask(int worker, int& task);
+    void runTasks(int worker);
+    void workerLoop(int worker);
+
+    // pools are not copyable
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator =(const ThreadPool&);
+};
+
+#endif // _threadpool_h
@@ -14,6 +14,7 @@
 #define _view_h
 
 #include <string>
+#include "cellref.h"
 
 /**
  * This pure virtual base class ("interface", in Java parlance) is used as a
@@ -24,6 +25,13 @@ public:
     virtual void clearCells() = 0;
     virtual void displayCell(int row, int column, const std::string& text) = 0;
     virtual void displayCell(const std::string& cellname, const std::string& text) = 0;
+
+    /**
+     * Displays the given text in the given cell, without building its name.
+     */
+    void displayCell(const CellRef& cell, const std::string& text) {
+        displayCell(cell.getRow(), cell.getColumn(), text);
+    }
 };
 
 #endif // _view_h